@@ -0,0 +1,557 @@
+#include "gcae.hpp"
+#include "posgen.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* Usage: bench [--suite NAME[,NAME...]] [--format csv|json] [--min-ms MS]
+                [--seed S] [--count N] [--rows R] [--cols C] [--monsters M] [--items I]
+                [--hp LO:HI] [--atk LO:HI] [--def LO:HI] [--stamina LO:HI] [--depth D]
+                [--threads N] [--threads-max N] [--smp root|lazy|auto] [--tt-mb N]
+ - Suites (default all):
+     movegen  next_states and generate_actions successors/sec over the maps and generated positions
+     codec    decode_state/encode_state and board decode/encode strings/sec over the same positions
+     eval     static_eval calls/sec over the same positions and their successors, and evaluations/sec
+              of static_eval_batch over each position's successor set
+     search   time-to-depth of the input.txt maps and the generated positions (--threads threads)
+     threads  time-to-depth of the input.txt maps with 1..--threads-max threads
+     table    regression check: each generated position searched in one session right after its
+              other-side twin must get the same answer as from an empty table (exit status 2 if not)
+ - Generated positions depend only on the generator options, so the same options give the same
+   positions on every build and platform.
+ - Output is one record per case, as CSV rows `suite,case,metric,value` or a JSON array of objects;
+   compare two runs on the same machine to catch regressions. Searches start from an empty table. */
+
+struct bench_position
+{
+    std::string name;
+    std::string text; // same format as best_move_from_stream input
+};
+
+// Maps from input.txt with a fixed search depth
+static const bench_position LANE_MAPS[] = {
+    {"lanes52x99_d6",
+     "52 99 A 6\n100 40 0 20 20\n100 40 0 20 20\n10\n"
+     "20 5 0 0\n0 15 0 0\n0 0 15 0\n0 0 0 10\n-10 10 0 0\n30 0 0 0\n0 -10 20 0\n0 0 -5 15\n25 5 5 0\n-20 0 0 20\n"
+     "A A50 m C30 m C70 m H20 m H80 m M40 m M60 m T25 m T75 m Y45 m Y55 o0 D50 o1 G10 o2 G90 o3 L50 o4 Q15 "
+     "o5 Q85 o6 V50 o7 X5 o8 X95 o9 Z50 B z50\n"},
+    {"center11x11_d5",
+     "11 11 A 5\n100 40 0 20 20\n100 40 0 20 20\n5\n15 0 0 0\n0 10 0 0\n0 0 10 0\n0 0 0 5\n-10 5 0 0\n"
+     "A A6 m C4 m C8 m F3 m F9 m I4 m I8 o0 D6 o1 F6 o2 H6 o3 E2 o4 G10 B K6\n"},
+    {"center7x7_d6",
+     "7 7 A 6\n100 40 0 20 20\n100 40 0 20 20\n2\n20 10 0 0\n0 0 0 5\n"
+     "A A4 m C2 m C6 m E2 m E6 o0 D4 o1 B4 B G4\n"},
+    {"boxed3x3_d6",
+     "3 3 A 6\n100 40 0 20 20\n100 40 0 20 20\n0\n"
+     "A A1 m A2 m A3 m B1 m C1 m C2 B C3\n"},
+};
+
+// Positions whose answer once depended on what a shared table had searched before
+static const bench_position TABLE_CASES[] = {
+    {"tie3x3_d10",
+     "3 3 B 10\n30 10 5 4 4\n30 10 5 4 4\n1\n0 0 0 0\nA B3 B B1 m A3 o0 C1\n"},
+};
+
+/* generate_positions
+ - g.count positions of one generator stream (see posgen.hpp). */
+static std::vector<bench_position> generate_positions(const gen_options &g)
+{
+    std::vector<bench_position> out;
+    gen_rng rng = {g.seed};
+    for (int k = 0; k < g.count; ++k)
+        out.push_back({"gen" + std::to_string(k), generate_position(g, rng)});
+    return out;
+}
+
+// A parsed position, for the suites that call the engine below best_move_from_stream
+struct parsed_position
+{
+    int H, W;
+    char player;
+    std::vector<item> items;
+    std::string encoded;
+    game_state gs;
+};
+
+static bool parse_position(const std::string &text, parsed_position &p)
+{
+    std::istringstream in(text);
+    int depth;
+    in >> p.H >> p.W >> p.player >> depth;
+    for (int k = 0; k < 2; ++k)
+        in >> p.gs.players[k].H >> p.gs.players[k].A >> p.gs.players[k].D >> p.gs.players[k].s >> p.gs.players[k].S;
+    int n;
+    in >> n;
+    if (!in || n < 0 || n > MAX_ITEMS)
+        return false;
+    p.items.resize(n);
+    for (item &it : p.items)
+        in >> it.dH >> it.dA >> it.dD >> it.dS;
+    std::getline(in, p.encoded);
+    std::getline(in, p.encoded);
+    return (bool)in && decode_state(p.H, p.W, p.encoded, p.gs);
+}
+
+// One output record: a case of a suite and its metrics in order
+struct bench_record
+{
+    std::string suite, name;
+    std::vector<std::pair<std::string, std::string>> metrics;
+    std::vector<bool> numeric;
+
+    void add(const char *metric, double v)
+    {
+        std::ostringstream s;
+        s.precision(10);
+        s << v;
+        metrics.emplace_back(metric, s.str());
+        numeric.push_back(true);
+    }
+    void add(const char *metric, const std::string &v)
+    {
+        metrics.emplace_back(metric, v);
+        numeric.push_back(false);
+    }
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ms(bench_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - t0).count();
+}
+
+/* run_timed
+ - Call body() in rounds until min_ms have passed; returns the elapsed time and sets rounds. */
+template <class F> static double run_timed(double min_ms, unsigned long long &rounds, F body)
+{
+    rounds = 0;
+    bench_clock::time_point t0 = bench_clock::now();
+    double ms;
+    do
+    {
+        body();
+        ++rounds;
+    } while ((ms = elapsed_ms(t0)) < min_ms);
+    return ms;
+}
+
+static volatile unsigned long long sink; // keeps the measured work from being optimized away
+
+static void bench_movegen(const std::vector<parsed_position> &ps, double min_ms, std::vector<bench_record> &out)
+{
+    std::vector<game_state> ngs;
+    std::vector<Move> moves;
+    unsigned long long rounds, succ = 0;
+    double ms = run_timed(min_ms, rounds, [&] {
+        for (const parsed_position &p : ps)
+            succ += next_states(p.H, p.W, p.gs, p.player, p.items, ngs, moves);
+    });
+    bench_record r = {"movegen", "next_states", {}, {}};
+    r.add("calls", (double)(rounds * ps.size()));
+    r.add("successors", (double)succ);
+    r.add("time_ms", ms);
+    r.add("calls_per_sec", rounds * ps.size() * 1000.0 / ms);
+    r.add("succ_per_sec", succ * 1000.0 / ms);
+    out.push_back(r);
+
+    // the search's own path: generate into a frame, then make/unmake each action
+    action acts[MAX_SUCCESSORS];
+    succ = 0;
+    ms = run_timed(min_ms, rounds, [&] {
+        for (const parsed_position &p : ps)
+        {
+            game_state gs = p.gs;
+            int n = generate_actions(p.H, p.W, gs, p.player, acts);
+            for (int i = 0; i < n; ++i)
+            {
+                move_undo u;
+                make_move(gs, acts[i], p.player, p.items, u);
+                sink += gs.hash;
+                unmake_move(gs, acts[i], p.player, u);
+            }
+            succ += n;
+        }
+    });
+    r = {"movegen", "generate_actions+make_unmake", {}, {}};
+    r.add("calls", (double)(rounds * ps.size()));
+    r.add("successors", (double)succ);
+    r.add("time_ms", ms);
+    r.add("calls_per_sec", rounds * ps.size() * 1000.0 / ms);
+    r.add("succ_per_sec", succ * 1000.0 / ms);
+    out.push_back(r);
+}
+
+static void bench_codec(const std::vector<parsed_position> &ps, double min_ms, std::vector<bench_record> &out)
+{
+    unsigned long long rounds, bytes = 0;
+    game_state gs;
+    double ms = run_timed(min_ms, rounds, [&] {
+        for (const parsed_position &p : ps)
+        {
+            decode_state(p.H, p.W, p.encoded, gs);
+            bytes += p.encoded.size();
+        }
+        sink += gs.occ[0][0];
+    });
+    bench_record r = {"codec", "decode_state", {}, {}};
+    r.add("strings_per_sec", rounds * ps.size() * 1000.0 / ms);
+    r.add("mb_per_sec", bytes / 1e3 / ms);
+    out.push_back(r);
+
+    std::string s;
+    bytes = 0;
+    ms = run_timed(min_ms, rounds, [&] {
+        for (const parsed_position &p : ps)
+        {
+            encode_state(p.gs, s);
+            bytes += s.size();
+        }
+    });
+    r = {"codec", "encode_state", {}, {}};
+    r.add("strings_per_sec", rounds * ps.size() * 1000.0 / ms);
+    r.add("mb_per_sec", bytes / 1e3 / ms);
+    out.push_back(r);
+
+    std::vector<std::vector<char>> board(MAX_ROWS);
+    bytes = 0;
+    ms = run_timed(min_ms, rounds, [&] {
+        for (const parsed_position &p : ps)
+        {
+            decode(p.H, p.W, board, p.encoded);
+            bytes += p.encoded.size();
+        }
+        sink += (unsigned long long)board[0][0];
+    });
+    r = {"codec", "decode", {}, {}};
+    r.add("strings_per_sec", rounds * ps.size() * 1000.0 / ms);
+    r.add("mb_per_sec", bytes / 1e3 / ms);
+    out.push_back(r);
+
+    std::vector<std::vector<std::vector<char>>> boards(ps.size(), std::vector<std::vector<char>>(MAX_ROWS));
+    for (size_t k = 0; k < ps.size(); ++k)
+        decode(ps[k].H, ps[k].W, boards[k], ps[k].encoded);
+    bytes = 0;
+    ms = run_timed(min_ms, rounds, [&] {
+        for (size_t k = 0; k < ps.size(); ++k)
+        {
+            encode(ps[k].H, ps[k].W, boards[k], s);
+            bytes += s.size();
+        }
+    });
+    r = {"codec", "encode", {}, {}};
+    r.add("strings_per_sec", rounds * ps.size() * 1000.0 / ms);
+    r.add("mb_per_sec", bytes / 1e3 / ms);
+    out.push_back(r);
+}
+
+static void bench_eval(const std::vector<parsed_position> &ps, double min_ms, std::vector<bench_record> &out)
+{
+    // evaluate the positions and their successors, so stats and layouts vary between calls
+    std::vector<game_state> states, ngs;
+    std::vector<Move> moves;
+    std::vector<char> roots;
+    for (const parsed_position &p : ps)
+    {
+        states.push_back(p.gs);
+        roots.push_back(p.player);
+        next_states(p.H, p.W, p.gs, p.player, p.items, ngs, moves);
+        for (const game_state &g : ngs)
+        {
+            states.push_back(g);
+            roots.push_back(p.player);
+        }
+    }
+
+    unsigned long long rounds;
+    double ms = run_timed(min_ms, rounds, [&] {
+        long long acc = 0;
+        for (size_t k = 0; k < states.size(); ++k)
+            acc += static_eval(states[k], roots[k]);
+        sink += (unsigned long long)acc;
+    });
+    bench_record r = {"eval", "static_eval", {}, {}};
+    r.add("states", (double)states.size());
+    r.add("calls_per_sec", rounds * states.size() * 1000.0 / ms);
+    out.push_back(r);
+
+    // the same kind of work as whole successor sets through the batched kernel
+    std::vector<eval_batch> batches;
+    std::vector<char> batch_roots;
+    size_t batched = 0;
+    int mismatches = 0; // lanes where the kernels disagree with static_eval
+    int scores[EVAL_BATCH_MAX];
+    for (const parsed_position &p : ps)
+    {
+        next_states(p.H, p.W, p.gs, p.player, p.items, ngs, moves);
+        batches.emplace_back();
+        for (const game_state &g : ngs)
+            batches.back().add(g);
+        batch_roots.push_back(p.player);
+        batched += ngs.size();
+        static_eval_batch(batches.back(), p.player, scores);
+        for (size_t i = 0; i < ngs.size(); ++i)
+            mismatches += scores[i] != static_eval(ngs[i], p.player);
+    }
+    ms = run_timed(min_ms, rounds, [&] {
+        long long acc = 0;
+        for (size_t k = 0; k < batches.size(); ++k)
+        {
+            static_eval_batch(batches[k], batch_roots[k], scores);
+            for (int i = 0; i < batches[k].n; ++i)
+                acc += scores[i];
+        }
+        sink += (unsigned long long)acc;
+    });
+    r = {"eval", "static_eval_batch", {}, {}};
+    r.add("states", (double)batched);
+    r.add("calls_per_sec", rounds * batched * 1000.0 / ms);
+    r.add("mismatches", mismatches);
+    out.push_back(r);
+}
+
+static const char *smp_name(int smp)
+{
+    return smp == SMP_ROOT ? "root" : smp == SMP_LAZY ? "lazy" : "auto";
+}
+
+static std::string move_text(const Move &m)
+{
+    return std::string(1, m.type) + m.torow + std::to_string(m.tocol);
+}
+
+static bench_record search_record(const char *suite, const bench_position &pos, TranspositionTable &tt, int threads,
+                                  int smp)
+{
+    tt.clear();
+    EngineOptions opt;
+    opt.tt = &tt;
+    opt.threads = threads;
+    opt.smp = smp;
+
+    std::istringstream in(pos.text);
+    bench_clock::time_point t0 = bench_clock::now();
+    EngineResult res = best_move_from_stream(in, opt);
+    double ms = elapsed_ms(t0);
+
+    bench_record r = {suite, pos.name, {}, {}};
+    r.add("threads", threads);
+    r.add("smp", smp_name(smp));
+    r.add("depth", res.stats.depth);
+    r.add("time_ms", ms);
+    r.add("nodes", (double)res.stats.nodes);
+    r.add("nps", ms > 0 ? res.stats.nodes * 1000.0 / ms : 0.0);
+    r.add("leaf_evals", (double)res.stats.leaf_evals);
+    r.add("branching", res.stats.branching_factor());
+    r.add("max_ply", res.stats.max_ply);
+    r.add("move", move_text(res.move));
+    r.add("score", res.score);
+    return r;
+}
+
+/* other_side
+ - pos with the other side to move and one more ply of depth, as a game's next request would be. */
+static std::string other_side(const std::string &text)
+{
+    std::istringstream in(text);
+    int H, W, depth;
+    char player;
+    in >> H >> W >> player >> depth;
+    std::string rest((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return std::to_string(H) + ' ' + std::to_string(W) + ' ' + (player == 'A' ? 'B' : 'A') + ' ' +
+           std::to_string(depth + 1) + rest;
+}
+
+/* bench_table
+ - Search every position from an empty table, then again in one session (shared table, contexts
+   and history) right after its other-side twin; both answers must agree.
+ - Returns the number of positions whose move or score differ. */
+static int bench_table(const std::vector<bench_position> &ps, size_t tt_mb, int threads, int smp,
+                       std::vector<bench_record> &out)
+{
+    TranspositionTable fresh(tt_mb);
+    SearchSession session(tt_mb);
+    int mismatches = 0;
+    double fresh_ms = 0, shared_ms = 0;
+    for (const bench_position &pos : ps)
+    {
+        EngineOptions opt;
+        opt.threads = threads;
+        opt.smp = smp;
+        fresh.clear();
+        opt.tt = &fresh;
+        std::istringstream in(pos.text);
+        bench_clock::time_point t0 = bench_clock::now();
+        EngineResult want = best_move_from_stream(in, opt);
+        fresh_ms += elapsed_ms(t0);
+
+        opt.tt = nullptr;
+        opt.session = &session;
+        std::istringstream twin(other_side(pos.text)), again(pos.text);
+        t0 = bench_clock::now();
+        best_move_from_stream(twin, opt);
+        EngineResult got = best_move_from_stream(again, opt);
+        shared_ms += elapsed_ms(t0);
+
+        if (move_text(want.move) != move_text(got.move) || want.score != got.score)
+        {
+            ++mismatches;
+            std::cerr << "table: " << pos.name << " answers " << move_text(got.move) << ' ' << got.score
+                      << " after its twin, " << move_text(want.move) << ' ' << want.score << " fresh\n";
+        }
+    }
+    bench_record r = {"table", "shared_vs_fresh", {}, {}};
+    r.add("positions", (double)ps.size());
+    r.add("mismatches", mismatches);
+    r.add("fresh_ms", fresh_ms);
+    r.add("shared_ms", shared_ms);
+    out.push_back(r);
+    return mismatches;
+}
+
+static void print_csv(const std::vector<bench_record> &records)
+{
+    std::cout << "suite,case,metric,value\n";
+    for (const bench_record &r : records)
+        for (const std::pair<std::string, std::string> &m : r.metrics)
+            std::cout << r.suite << ',' << r.name << ',' << m.first << ',' << m.second << '\n';
+}
+
+static void print_json(const std::vector<bench_record> &records)
+{
+    std::cout << "[\n";
+    for (size_t k = 0; k < records.size(); ++k)
+    {
+        const bench_record &r = records[k];
+        std::cout << "  {\"suite\": \"" << r.suite << "\", \"case\": \"" << r.name << '"';
+        for (size_t m = 0; m < r.metrics.size(); ++m)
+        {
+            std::cout << ", \"" << r.metrics[m].first << "\": ";
+            if (r.numeric[m])
+                std::cout << r.metrics[m].second;
+            else
+                std::cout << '"' << r.metrics[m].second << '"';
+        }
+        std::cout << (k + 1 < records.size() ? "},\n" : "}\n");
+    }
+    std::cout << "]\n";
+}
+
+int main(int argc, char **argv)
+{
+    std::string suites = "movegen,codec,eval,search,threads,table";
+    bool json = false;
+    double min_ms = 300;
+    gen_options g;
+    int threads = 1;
+    int threads_max = (int)std::max(1u, std::thread::hardware_concurrency());
+    int smp = SMP_AUTO;
+    size_t tt_mb = 64;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i)
+    {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!v)
+            ok = false;
+        else if (std::strcmp(a, "--suite") == 0)
+            suites = v;
+        else if (std::strcmp(a, "--format") == 0)
+            json = std::strcmp(v, "json") == 0;
+        else if (std::strcmp(a, "--min-ms") == 0)
+            min_ms = std::atof(v);
+        else if (std::strcmp(a, "--seed") == 0)
+            g.seed = std::strtoull(v, nullptr, 10);
+        else if (std::strcmp(a, "--count") == 0)
+            g.count = std::max(1, std::atoi(v));
+        else if (std::strcmp(a, "--rows") == 0)
+            g.rows = std::min(MAX_ROWS, std::max(1, std::atoi(v)));
+        else if (std::strcmp(a, "--cols") == 0)
+            g.cols = std::min(MAX_COLS, std::max(1, std::atoi(v)));
+        else if (std::strcmp(a, "--monsters") == 0)
+            g.monsters = std::min(MAX_MONSTERS, std::max(0, std::atoi(v)));
+        else if (std::strcmp(a, "--items") == 0)
+            g.items = std::min(MAX_ITEMS, std::max(0, std::atoi(v)));
+        else if (std::strcmp(a, "--hp") == 0)
+            ok = parse_range(v, g.hp);
+        else if (std::strcmp(a, "--atk") == 0)
+            ok = parse_range(v, g.atk);
+        else if (std::strcmp(a, "--def") == 0)
+            ok = parse_range(v, g.def);
+        else if (std::strcmp(a, "--stamina") == 0)
+            ok = parse_range(v, g.stamina);
+        else if (std::strcmp(a, "--depth") == 0)
+            g.depth = std::max(1, std::atoi(v));
+        else if (std::strcmp(a, "--threads") == 0)
+            threads = std::max(1, std::atoi(v));
+        else if (std::strcmp(a, "--threads-max") == 0)
+            threads_max = std::max(1, std::atoi(v));
+        else if (std::strcmp(a, "--smp") == 0)
+            smp = std::strcmp(v, "root") == 0 ? SMP_ROOT : std::strcmp(v, "lazy") == 0 ? SMP_LAZY : SMP_AUTO;
+        else if (std::strcmp(a, "--tt-mb") == 0)
+            tt_mb = (size_t)std::strtoul(v, nullptr, 10);
+        else
+            ok = false;
+        ++i;
+    }
+    if (!ok)
+    {
+        std::cerr << "usage: " << argv[0] << " [--suite movegen,codec,eval,search,threads,table] [--format csv|json] [--min-ms MS]\n"
+                  << "       [--seed S] [--count N] [--rows R] [--cols C] [--monsters M] [--items I]\n"
+                  << "       [--hp LO:HI] [--atk LO:HI] [--def LO:HI] [--stamina LO:HI] [--depth D]\n"
+                  << "       [--threads N] [--threads-max N] [--smp root|lazy|auto] [--tt-mb N]\n";
+        return 1;
+    }
+    std::string wanted = "," + suites + ",";
+    auto enabled = [&](const char *suite) { return wanted.find("," + std::string(suite) + ",") != std::string::npos; };
+
+    std::vector<bench_position> generated = generate_positions(g);
+    std::vector<bench_position> all(std::begin(LANE_MAPS), std::end(LANE_MAPS));
+    all.insert(all.end(), generated.begin(), generated.end());
+    std::vector<parsed_position> parsed;
+    for (const bench_position &pos : all)
+    {
+        parsed.emplace_back();
+        if (!parse_position(pos.text, parsed.back()))
+            parsed.pop_back();
+    }
+
+    std::vector<bench_record> records;
+    if (enabled("movegen"))
+        bench_movegen(parsed, min_ms, records);
+    if (enabled("codec"))
+        bench_codec(parsed, min_ms, records);
+    if (enabled("eval"))
+        bench_eval(parsed, min_ms, records);
+
+    TranspositionTable tt(tt_mb);
+    if (enabled("search"))
+        for (const bench_position &pos : all)
+            records.push_back(search_record("search", pos, tt, threads, smp));
+    if (enabled("threads"))
+        for (const bench_position &pos : LANE_MAPS)
+            for (int t = 1; t <= threads_max; ++t)
+                records.push_back(search_record("threads", pos, tt, t, smp));
+    int mismatches = 0;
+    if (enabled("table"))
+    {
+        std::vector<bench_position> cases(std::begin(TABLE_CASES), std::end(TABLE_CASES));
+        cases.insert(cases.end(), generated.begin(), generated.end());
+        mismatches = bench_table(cases, tt_mb, threads, smp, records);
+    }
+
+    if (json)
+        print_json(records);
+    else
+        print_csv(records);
+    return mismatches ? 2 : 0;
+}
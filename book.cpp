@@ -0,0 +1,154 @@
+#include "book.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* check_table
+ - The slot count must be a power of two and fit in the file. */
+static bool check_table(const file_header &h, size_t available, std::string &error)
+{
+    if (h.count == 0 || (h.count & (h.count - 1)) != 0)
+        error = "slot count is not a power of two";
+    else if (h.count > available / sizeof(book_entry))
+        error = "truncated table";
+    else
+        return true;
+    return false;
+}
+
+#ifndef _WIN32
+
+OpeningBook::~OpeningBook()
+{
+    if (base)
+        munmap(base, bytes);
+}
+
+bool OpeningBook::open(const std::string &path, std::string &error)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) < 0)
+    {
+        error = std::strerror(errno);
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    bytes = (size_t)sb.st_size;
+    if (bytes < sizeof(file_header))
+    {
+        ::close(fd);
+        error = "truncated header";
+        return false;
+    }
+    // shared and read-only: every process using the book reads the same page-cache pages
+    base = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        base = nullptr;
+        error = std::strerror(errno);
+        return false;
+    }
+    madvise(base, bytes, MADV_RANDOM);
+
+    const file_header &h = *(const file_header *)base;
+    if (!check_header(h, BOOK_MAGIC, sizeof(book_entry), error) || !check_table(h, bytes - sizeof h, error))
+        return false;
+    table = (const book_entry *)((const char *)base + sizeof h);
+    mask = (size_t)h.count - 1;
+    return true;
+}
+
+#else
+
+// No mmap: read the whole table into memory.
+
+OpeningBook::~OpeningBook()
+{
+    delete[] (char *)base;
+}
+
+bool OpeningBook::open(const std::string &path, std::string &error)
+{
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        error = std::strerror(errno);
+        return false;
+    }
+    file_header h;
+    bool ok = std::fread(&h, sizeof h, 1, f) == 1;
+    if (!ok)
+        error = "truncated header";
+    else if ((ok = check_header(h, BOOK_MAGIC, sizeof(book_entry), error) && check_table(h, (size_t)-1, error)))
+    {
+        bytes = (size_t)h.count * sizeof(book_entry);
+        base = new char[bytes];
+        ok = std::fread(base, 1, bytes, f) == bytes;
+        if (!ok)
+            error = "truncated table";
+    }
+    std::fclose(f);
+    if (!ok)
+        return false;
+    table = (const book_entry *)base;
+    mask = (size_t)h.count - 1;
+    return true;
+}
+
+#endif
+
+bool write_book(const std::string &path, const std::vector<book_entry> &entries, std::string &error)
+{
+    size_t slots = 16;
+    while (slots < entries.size() * 2)
+        slots *= 2;
+    std::vector<book_entry> table(slots);
+    std::memset(table.data(), 0, slots * sizeof(book_entry));
+    for (const book_entry &e : entries)
+    {
+        if (e.key == 0)
+            continue;
+        size_t i = e.key & (slots - 1);
+        while (table[i].key != 0 && table[i].key != e.key)
+            i = (i + 1) & (slots - 1);
+        if (table[i].key == 0 || e.depth > table[i].depth)
+            table[i] = e;
+    }
+
+    file_header h;
+    std::memcpy(h.magic, BOOK_MAGIC, sizeof h.magic);
+    h.byte_order = FILE_BYTE_ORDER;
+    h.record_size = sizeof(book_entry);
+    h.count = slots;
+
+    std::string tmp = path + ".tmp";
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    bool ok = f && std::fwrite(&h, sizeof h, 1, f) == 1 &&
+              std::fwrite(table.data(), sizeof(book_entry), slots, f) == slots;
+    if (f && std::fclose(f) != 0)
+        ok = false;
+    if (ok)
+    {
+#ifdef _WIN32
+        std::remove(path.c_str()); // rename does not replace an existing file here
+#endif
+        ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+    {
+        error = std::strerror(errno);
+        std::remove(tmp.c_str());
+    }
+    return ok;
+}
@@ -0,0 +1,70 @@
+#ifndef GCAE_BOOK_HPP
+#define GCAE_BOOK_HPP
+
+#include "gcae.hpp"
+#include "posfile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Opening book (gcae --book FILE, written by bookgen).
+//
+// A file_header followed by a power-of-two table of book_entry slots, indexed by position_key with
+// linear probing; key 0 marks an empty slot and at most half the slots are used. The file is mapped
+// read-only and shared, so any number of engine processes probe one copy in the page cache: a
+// lookup reads the mapping in place, with no copy and no lock. bookgen replaces a book by renaming
+// a new file over it, so a process that has the old one mapped keeps a consistent view.
+
+const char BOOK_MAGIC[8] = {'G', 'C', 'A', 'E', 'B', 'O', 'K', '1'};
+
+struct book_entry
+{
+    uint64_t key;    // position_key of the position; 0 = empty slot
+    Move move;       // best move found
+    int32_t score;   // its score, from the side to move's point of view
+    int32_t depth;   // search depth behind it
+    uint32_t reserved;
+};
+
+static_assert(sizeof(book_entry) == 24, "book_entry layout");
+
+class OpeningBook
+{
+public:
+    OpeningBook() = default;
+    ~OpeningBook();
+    OpeningBook(const OpeningBook &) = delete;
+    OpeningBook &operator=(const OpeningBook &) = delete;
+
+    bool open(const std::string &path, std::string &error);
+    size_t slots() const { return mask ? mask + 1 : 0; }
+
+    // Entry of `key`, or nullptr; safe to call from any number of threads.
+    const book_entry *probe(uint64_t key) const
+    {
+        if (!table || key == 0)
+            return nullptr;
+        for (size_t i = key & mask, n = 0; n <= mask; i = (i + 1) & mask, ++n)
+        {
+            if (table[i].key == key)
+                return &table[i];
+            if (table[i].key == 0)
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+private:
+    void *base = nullptr;
+    size_t bytes = 0;
+    const book_entry *table = nullptr;
+    size_t mask = 0;
+};
+
+// Write entries as a book at path (through a temporary file renamed over it). Of two entries with
+// the same key the deeper one is kept.
+bool write_book(const std::string &path, const std::vector<book_entry> &entries, std::string &error);
+
+#endif // GCAE_BOOK_HPP
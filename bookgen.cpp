@@ -0,0 +1,203 @@
+#include "book.hpp"
+#include "gcae.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/* Usage: bookgen --out FILE [--depth D] [--plies N] [--width K] [--scout-depth D] [--tt-mb N] [--threads N]
+                  < positions
+ - Reads END-separated start positions (the gcae input format; their header depth is ignored) and
+   searches each one --depth deep (default 8), then its likely continuations up to --plies moves
+   ahead (default 6). Continuations follow the README turn rules, so both players' positions are
+   covered. At each position the --width moves (default 2) that score best after a --scout-depth
+   search of the position they lead to (default depth - 2) are followed.
+ - Writes every searched position with its best move, score and depth as an opening book
+   (book.hpp) for gcae --book. One search session is used throughout, so transpositions and
+   shared lines are searched warm. */
+
+struct book_options
+{
+    const char *out = nullptr;
+    int depth = 8;
+    int plies = 6;
+    int width = 2;
+    int scout_depth = -1; // depth - 2
+    size_t tt_mb = 64;
+    int threads = 1;
+};
+
+static bool game_over(const position_request &req)
+{
+    return req.gs.players[0].H <= 0 || req.gs.players[1].H <= 0;
+}
+
+/* likely_moves
+ - The moves of req in the order a scout search ranks them for req.player, best first. */
+static std::vector<Move> likely_moves(const position_request &req, const book_options &bo, const EngineOptions &eo)
+{
+    std::vector<game_state> ngs;
+    std::vector<Move> moves;
+    int n = next_states(req.H, req.W, req.gs, req.player, req.items, ngs, moves);
+    std::vector<std::pair<int, int>> ranked; // (score for req.player, generation index)
+    for (int i = 0; i < n; ++i)
+    {
+        position_request child = req;
+        if (!play_move(child, moves[i]))
+            continue;
+        int score;
+        if (game_over(child))
+        {
+            int me = req.player == 'A' ? 0 : 1;
+            score = child.gs.players[1 - me].H <= 0 ? 1000000 : -1000000;
+        }
+        else
+        {
+            child.depth = bo.scout_depth;
+            child.movetime_ms = -1;
+            int s = best_move_from_request(child, eo).score;
+            score = child.player == req.player ? s : -s;
+        }
+        ranked.push_back({score, i});
+    }
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [](const std::pair<int, int> &a, const std::pair<int, int> &b) { return a.first > b.first; });
+    std::vector<Move> out;
+    for (const std::pair<int, int> &r : ranked)
+        out.push_back(moves[r.second]);
+    return out;
+}
+
+/* expand
+ - Search every position reachable from start within bo.plies moves along likely moves; positions
+   already in `seen` are skipped. */
+static void expand(const position_request &start, const book_options &bo, const EngineOptions &eo,
+                   std::unordered_set<unsigned long long> &seen, std::vector<book_entry> &entries)
+{
+    std::vector<std::pair<position_request, int>> stack(1, std::make_pair(start, 0));
+    while (!stack.empty())
+    {
+        position_request req = std::move(stack.back().first);
+        int ply = stack.back().second;
+        stack.pop_back();
+        unsigned long long key = position_key(req);
+        if (key == 0 || !seen.insert(key).second)
+            continue;
+
+        req.depth = bo.depth;
+        req.movetime_ms = -1;
+        EngineResult r = best_move_from_request(req, eo);
+        book_entry e;
+        std::memset(&e, 0, sizeof e);
+        e.key = key;
+        e.move = r.move;
+        e.score = r.score;
+        e.depth = r.stats.depth;
+        entries.push_back(e);
+        if (entries.size() % 100 == 0)
+            std::cerr << entries.size() << " positions\n";
+
+        if (ply + 1 >= bo.plies)
+            continue;
+        std::vector<Move> follow(1, r.move);
+        if (bo.width > 1)
+            for (const Move &m : likely_moves(req, bo, eo))
+                if ((int)follow.size() < bo.width &&
+                    !(m.type == r.move.type && m.torow == r.move.torow && m.tocol == r.move.tocol))
+                    follow.push_back(m);
+        // pushed in reverse so the best line is expanded first
+        for (size_t i = follow.size(); i-- > 0;)
+        {
+            position_request next = req;
+            if (play_move(next, follow[i]) && !game_over(next))
+                stack.push_back(std::make_pair(std::move(next), ply + 1));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    book_options bo;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i)
+    {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!v)
+            ok = false;
+        else if (std::strcmp(a, "--out") == 0)
+            bo.out = v;
+        else if (std::strcmp(a, "--depth") == 0)
+            bo.depth = std::max(1, std::atoi(v));
+        else if (std::strcmp(a, "--plies") == 0)
+            bo.plies = std::max(1, std::atoi(v));
+        else if (std::strcmp(a, "--width") == 0)
+            bo.width = std::max(1, std::atoi(v));
+        else if (std::strcmp(a, "--scout-depth") == 0)
+            bo.scout_depth = std::max(0, std::atoi(v));
+        else if (std::strcmp(a, "--tt-mb") == 0)
+            bo.tt_mb = (size_t)std::strtoul(v, nullptr, 10);
+        else if (std::strcmp(a, "--threads") == 0)
+            bo.threads = std::atoi(v);
+        else
+            ok = false;
+        ++i;
+    }
+    if (!ok || !bo.out)
+    {
+        std::cerr << "usage: " << argv[0] << " --out FILE [--depth D] [--plies N] [--width K] [--scout-depth D]\n"
+                  << "       [--tt-mb N] [--threads N] < positions\n";
+        return 1;
+    }
+    if (bo.scout_depth < 0)
+        bo.scout_depth = std::max(1, bo.depth - 2);
+
+    SearchSession session(bo.tt_mb);
+    EngineOptions eo;
+    eo.session = &session;
+    eo.threads = bo.threads;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::unordered_set<unsigned long long> seen;
+    std::vector<book_entry> entries;
+    std::string line, text;
+    int starts = 0;
+    while (true)
+    {
+        bool more = static_cast<bool>(std::getline(std::cin, line));
+        if (more && line != "END")
+        {
+            text += line + "\n";
+            continue;
+        }
+        position_request req;
+        std::istringstream in(text);
+        if (read_request(in, req))
+        {
+            ++starts;
+            expand(req, bo, eo, seen, entries);
+        }
+        else if (text.find_first_not_of(" \t\r\n") != std::string::npos)
+            std::cerr << "skipping a position that does not parse\n";
+        text.clear();
+        if (!more)
+            break;
+    }
+
+    std::string error;
+    if (!write_book(bo.out, entries, error))
+    {
+        std::cerr << bo.out << ": " << error << "\n";
+        return 1;
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "start positions " << starts << ", book positions " << entries.size() << ", depth " << bo.depth
+              << ", " << s << " s\n";
+    return 0;
+}
@@ -1,15 +1,55 @@
 #include "gcae.hpp"
+#include "book.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cctype>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
 #include <fstream>
+#include <new>
 #include <iostream>
 #include <limits>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#endif
+
 const int INF = std::numeric_limits<int>::max() / 4;
+const int MAX_DEPTH = 64; // iterative deepening cap when the request gives no depth
+const int ASPIRATION_WINDOW = 50; // initial half-width of the root window around the previous score
+
+#ifdef GCAE_COUNT_ALLOCS
+/* Debug build (-DGCAE_COUNT_ALLOCS): count heap allocations per thread so the search can report
+   how many it made (SearchStats::allocations); steady-state search should make none. */
+static thread_local unsigned long long alloc_count = 0;
+
+void *operator new(std::size_t n)
+{
+    ++alloc_count;
+    void *p = std::malloc(n ? n : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif
 
 /* indexToRowChar
  - Convert numeric row index (0..51) into encoded character ('A'..'Z', 'a'..'z').
@@ -33,6 +73,37 @@ static inline int rowCharToIndex(char c)
     return -1;
 }
 
+/* Board classes
+ - The move generator and the search are instantiated per side to move and per board class, and the
+   public entry points pick the instantiation once. On a board of at most 26 rows every row is
+   'A'..'Z', so converting a row index to its character and back is a single add or subtract.
+ - Columns are stored as numbers throughout (Move::tocol), so they need no class of their own. */
+enum board_class
+{
+    BOARD_SMALL, // H <= 26
+    BOARD_FULL   // up to MAX_ROWS
+};
+
+static inline int board_class_of(int H)
+{
+    return H <= 26 ? BOARD_SMALL : BOARD_FULL;
+}
+
+template <int BC> static inline char row_char(int idx)
+{
+    return BC == BOARD_SMALL ? static_cast<char>('A' + idx) : indexToRowChar(idx);
+}
+
+template <int BC> static inline int row_index(char c)
+{
+    return BC == BOARD_SMALL ? c - 'A' : rowCharToIndex(c);
+}
+
+static constexpr char side_char(int cp)
+{
+    return cp ? 'B' : 'A';
+}
+
 /* encode
  - Serialize a 2D board into the engine's compact state string.
  - Emits tokens only for letters/digits, prefixed with 'o' for numeric objects. */
@@ -110,340 +181,367 @@ void decode(int H, int W, std::vector<std::vector<char>> &board, const std::stri
     }
 }
 
-/* getrow
- - Read a single row character from encoded token at pos and advance pos.
- - Lightweight helper used by parsing routines. */
-static inline char getrow(const std::string &str, int &pos)
+/* occ_set / occ_clear
+ - Mark or unmark (row, col) in the per-row occupancy bitmap of gs. */
+static inline void occ_set(game_state &gs, int row, int col)
 {
-    char c = str[pos];
-    ++pos;
-    return c;
+    gs.occ[row][col >> 6] |= 1ULL << (col & 63);
 }
 
-/* getcol
- - Read a 1- or 2-digit column from encoded string at pos and advance pos.
- - Supports columns up to 99. */
-static inline int getcol(const std::string &str, int &pos)
+static inline void occ_clear(game_state &gs, int row, int col)
 {
-    int col = 0;
-    if (pos + 1 < (int)str.size() && std::isdigit(static_cast<unsigned char>(str[pos + 1])))
-    {
-        col = (str[pos++] - '0') * 10;
-    }
-    col += (str[pos++] - '0');
-    return col;
+    gs.occ[row][col >> 6] &= ~(1ULL << (col & 63));
 }
 
-/* add_c
- - Insert `len` null characters at `start` in the string (bounds-checked).
- - Thin wrapper kept for compatibility with original logic. */
-static inline int add_c(std::string &s, int start, int len)
+/* zmix
+ - 64-bit finalizer (splitmix64) used to derive Zobrist keys on the fly.
+ - Keys are computed from the packed feature instead of stored tables, so stats of any value get a key. */
+static inline unsigned long long zmix(unsigned long long x)
 {
-    if (start < 0 || len <= 0 || start > (int)s.size())
-        return -1;
-    s.insert((size_t)start, std::string(len, '\0'));
-    return 1;
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
 }
 
-/* delete_c
- - Remove `len` characters from `start` in the string (bounds-safe).
- - Used to remove object/monster tokens from the encoded state. */
-static inline int delete_c(std::string &s, int start, int len)
+/* player_key / item_key / monster_key
+ - Zobrist keys of one player (stats, stamina and coordinates) and of a live item or monster. */
+static inline unsigned long long player_key(int p, const player &pl, cell c)
 {
-    if (start < 0 || len <= 0 || start > (int)s.size())
-        return -1;
-    if (start + len > (int)s.size())
-        len = (int)s.size() - start;
-    s.erase((size_t)start, (size_t)len);
-    return 1;
+    unsigned long long stats = (unsigned long long)(unsigned short)pl.H | (unsigned long long)(unsigned short)pl.A << 16 |
+                               (unsigned long long)(unsigned short)pl.D << 32 |
+                               (unsigned long long)(unsigned short)pl.s << 48;
+    unsigned long long rest = (unsigned long long)(unsigned short)pl.S | (unsigned long long)c.row << 16 |
+                              (unsigned long long)c.col << 24 | (unsigned long long)(p + 1) << 32;
+    return zmix(zmix(stats) ^ rest);
 }
 
-/* distance_rc
- - Return Manhattan distance between two encoded positions (row char + column).
- - Converts row characters to numeric indices first. */
-static inline int distance_rc(char row, int col, char row2, int col2)
+static inline unsigned long long item_key(int id, cell c)
 {
-    int r1 = rowCharToIndex(row), r2 = rowCharToIndex(row2);
-    int vr = (r1 > r2) ? r1 - r2 : r2 - r1;
-    int vc = (col > col2) ? col - col2 : col2 - col;
-    return vr + vc;
+    return zmix(0x10000000ULL | (unsigned long long)id << 16 | (unsigned long long)c.row << 8 | c.col);
 }
 
-/* closest_valid_point
- - Compute the nearest reachable valid position toward a target within at most `s` movement points.
- - A position is valid if it lies within board bounds and is not already occupied in the encoded state string.
- - Progressively relaxes the path allocation between primary and secondary movement budgets until a valid tile is found.
- */
-static point closest_valid_point(char row, int col, char cp_row, int cp_col, int s, const std::string &str, int H,
-                                 int W)
+static inline unsigned long long monster_key(cell c)
 {
-    /* compute_closest
-     - Internal heuristic that advances from the current position toward the target.
-     - Uses two movement budgets: primary (direct approach) and secondary (adjustments).
-     - Returns the resulting intermediate point without validating occupancy. */
-    auto compute_closest = [&](int s1, int s2) -> point {
-        int target_row = rowCharToIndex(row);
-        int start_row = rowCharToIndex(cp_row);
+    return zmix(0x20000000ULL | (unsigned long long)c.row << 8 | c.col);
+}
 
-        int cur_row = start_row;
-        int cur_col = cp_col;
+/* side_key / pass_key
+ - Keys mixed in at probe time: side to move, and the pass counter with its limit (both change the value). */
+static inline unsigned long long side_key(char current_player)
+{
+    return current_player == 'B' ? 0x6A09E667F3BCC909ULL : 0;
+}
 
-        // primary directional movement
-        while (cur_row < target_row && s1)
-        {
-            ++cur_row;
-            --s1;
-        }
-        while (cur_col < col && s1)
+static inline unsigned long long pass_key(int consecutivePasses, int maxpasses)
+{
+    return zmix(0x30000000ULL | (unsigned long long)consecutivePasses << 8 | (unsigned long long)maxpasses);
+}
+
+/* root_key
+ - Key of the search a stored score belongs to: its root player (scores are not antisymmetric, since
+   close_game_eval gives a stat tie to the opponent of whoever searches) and whether leaves go
+   through quiescence. Mixed into every table key, so a table shared across requests answers each
+   one as a fresh table would. */
+static inline unsigned long long root_key(char root_player, bool quiescence)
+{
+    return zmix(0x50000000ULL | (unsigned long long)(root_player == 'B') << 1 | (unsigned long long)quiescence);
+}
+
+/* game_key
+ - Key of the fixed game setup (board size and item table), so tables shared across requests
+   never confuse positions from different games. */
+static unsigned long long game_key(int H, int W, const std::vector<item> &items)
+{
+    unsigned long long h = zmix(0x40000000ULL | (unsigned long long)H << 8 | (unsigned long long)W);
+    for (const item &it : items)
+    {
+        unsigned long long v = (unsigned long long)(unsigned short)it.dH | (unsigned long long)(unsigned short)it.dA << 16 |
+                               (unsigned long long)(unsigned short)it.dD << 32 |
+                               (unsigned long long)(unsigned short)it.dS << 48;
+        h = zmix(h ^ v);
+    }
+    return h;
+}
+
+/* state_hash
+ - Full Zobrist key of gs; make_move keeps it up to date incrementally. */
+static unsigned long long state_hash(const game_state &gs, unsigned long long setup)
+{
+    unsigned long long h = setup;
+    for (int p = 0; p < 2; ++p)
+        h ^= player_key(p, gs.players[p], gs.pos[p]);
+    for (int k = 0; k < gs.n_items; ++k)
+        if (gs.item_alive >> k & 1u)
+            h ^= item_key(gs.item_id[k], gs.item_pos[k]);
+    for (int k = 0; k < gs.n_monsters; ++k)
+        if (gs.monster_alive >> k & 1u)
+            h ^= monster_key(gs.monster_pos[k]);
+    return h;
+}
+
+/* decode_state
+ - Parse the compact state string into a game_state (same tokenization as decode).
+ - Entities are kept in the order they appear; fails on missing players or too many entities. */
+bool decode_state(int H, int W, const std::string &s, game_state &gs)
+{
+    gs.n_items = 0;
+    gs.n_monsters = 0;
+    gs.item_alive = 0;
+    gs.monster_alive = 0;
+    gs.hash = 0;
+    for (int r = 0; r < MAX_ROWS; ++r)
+        gs.occ[r][0] = gs.occ[r][1] = 0;
+    bool seen[2] = {false, false};
+
+    size_t i = 0, n = s.size();
+    while (i < n)
+    {
+        if (s[i] == ' ')
         {
-            ++cur_col;
-            --s1;
+            ++i;
+            continue;
         }
-        while (cur_row > target_row && s1)
+        bool is_obj = false;
+        if (s[i] == 'o')
         {
-            --cur_row;
-            --s1;
+            is_obj = true;
+            ++i;
+            if (i >= n)
+                break;
         }
-        while (cur_col > col && s1)
+        char ent = s[i++]; // entity char
+        if (i < n && s[i] == ' ')
+            ++i;
+        if (i >= n)
+            break;
+        char rowChar = s[i++];
+        int row = rowCharToIndex(rowChar);
+        if (row < 0)
+            continue;
+        if (i >= n)
+            break;
+        int col = s[i++] - '0';
+        if (i < n && std::isdigit(static_cast<unsigned char>(s[i])))
         {
-            --cur_col;
-            --s1;
+            col = col * 10 + (s[i++] - '0');
         }
+        if (i < n && s[i] == ' ')
+            ++i;
+        if (!(row >= 0 && row < H && col >= 1 && col <= W))
+            continue;
 
-        // secondary adjustments
-        while (cur_col < col && s2)
-        {
-            ++cur_col;
-            --s2;
-        }
-        while (cur_col > col && s2)
+        cell c = {(unsigned char)row, (unsigned char)col};
+        if (is_obj || ent == 'm' || ent == 'A' || ent == 'B')
+            occ_set(gs, row, col);
+        if (is_obj)
         {
-            --cur_col;
-            --s2;
+            if (!std::isdigit(static_cast<unsigned char>(ent)) || gs.n_items >= MAX_ITEMS)
+                return false;
+            gs.item_id[gs.n_items] = (unsigned char)(ent - '0');
+            gs.item_pos[gs.n_items] = c;
+            gs.item_alive |= (unsigned short)(1u << gs.n_items);
+            ++gs.n_items;
         }
-        while (cur_row < target_row && s2)
+        else if (ent == 'm')
         {
-            ++cur_row;
-            --s2;
+            if (gs.n_monsters >= MAX_MONSTERS)
+                return false;
+            gs.monster_pos[gs.n_monsters] = c;
+            gs.monster_alive |= 1u << gs.n_monsters;
+            ++gs.n_monsters;
         }
-        while (cur_row > target_row && s2)
+        else if (ent == 'A' || ent == 'B')
         {
-            --cur_row;
-            --s2;
+            gs.pos[ent - 'A'] = c;
+            seen[ent - 'A'] = true;
         }
+    }
+    return seen[0] && seen[1];
+}
 
-        point p;
-        p.row = indexToRowChar(cur_row);
-        p.col = cur_col;
-        return p;
-    };
-
-    auto is_valid = [&](const point &p) -> bool {
-        int ridx = rowCharToIndex(p.row);
-        if (!(ridx >= 0 && ridx < H && p.col > 0 && p.col <= W))
-            return false;
-
-        std::string sub;
-        sub.push_back(p.row);
-        if (p.col > 9)
-            sub.push_back(char('0' + (p.col / 10) % 10));
-        sub.push_back(char('0' + (p.col % 10)));
-
-        return (str.find(sub) == std::string::npos);
-    };
-
-    // Initial attempt using full primary budget
-    point closest = compute_closest(s, 0);
+/* append_cell
+ - Append the encoded coordinate (row char + column) of c to out. */
+static inline void append_cell(std::string &out, cell c)
+{
+    out.push_back(indexToRowChar(c.row));
+    if (c.col >= 10)
+        out.push_back(char('0' + (c.col / 10) % 10));
+    out.push_back(char('0' + (c.col % 10)));
+}
 
-    // If invalid, progressively rebalance primary/secondary budgets
-    while (!is_valid(closest) && s > 0)
+/* encode_state
+ - Serialize a game_state back into the compact state string.
+ - Emits players, then live monsters and items in slot order, so decode_state round-trips. */
+void encode_state(const game_state &gs, std::string &out)
+{
+    out.clear();
+    for (int p = 0; p < 2; ++p)
     {
-        int s2 = 0;
-        while (!is_valid(closest) && s2 <= s)
-        {
-            closest = compute_closest(s - s2, s2);
-            ++s2;
-        }
-        --s;
+        out.push_back(char('A' + p));
+        out.push_back(' ');
+        append_cell(out, gs.pos[p]);
+        out.push_back(' ');
     }
-
-    return closest;
+    for (int k = 0; k < gs.n_monsters; ++k)
+    {
+        if (!(gs.monster_alive >> k & 1u))
+            continue;
+        out += "m ";
+        append_cell(out, gs.monster_pos[k]);
+        out.push_back(' ');
+    }
+    for (int k = 0; k < gs.n_items; ++k)
+    {
+        if (!(gs.item_alive >> k & 1u))
+            continue;
+        out.push_back('o');
+        out.push_back(char('0' + gs.item_id[k]));
+        out.push_back(' ');
+        append_cell(out, gs.item_pos[k]);
+        out.push_back(' ');
+    }
+    if (!out.empty())
+        out.pop_back();
 }
 
-static inline short maxim(short a, short b)
+/* distance_rc
+ - Return Manhattan distance between two positions given as row index + column. */
+static inline int distance_rc(int r1, int col, int r2, int col2)
 {
-    return (a > b) ? a : b;
+    int vr = (r1 > r2) ? r1 - r2 : r2 - r1;
+    int vc = (col > col2) ? col - col2 : col2 - col;
+    return vr + vc;
 }
 
-/* isobject_index
- - Determine whether the byte at index i is an object prefix ('o') in the encoded string.
- - Avoid false positives near other tokens. */
-static bool isobject_index(int i, const std::string &s)
+/* occupied
+ - True if a player, live monster or live item stands on (row, col). */
+static inline bool occupied(const game_state &gs, int row, int col)
 {
-    if (i < 0 || i >= (int)s.size())
-        return false;
-    if (s[i] != 'o')
-        return false;
-    if (i == 0)
-        return true;
-    if (i - 2 >= 0)
-    {
-        char prev = s[i - 2];
-        if (prev == 'm' || prev == 'A' || prev == 'B')
-            return false;
-    }
-    return true;
+    return (gs.occ[row][col >> 6] >> (col & 63)) & 1ULL;
 }
 
-/* end_round_state
- - Produce a copy of src into dest and set move to 'pass' type.
- - Used to represent end-of-turn/no-op successor. */
-static void end_round_state(game_state &dest, const game_state &src, Move &m, int cp, int op)
-{
-    m.type = 'p';
-    m.torow = '.';
-    m.tocol = 0;
-    dest = src;
-}
-
-/* move_player_apply
- - Update the player's encoded position inside the provided dest.game_state string.
- - Operates on current dest.s so that any prior deletions/insertions are respected. */
-static bool move_player_apply(game_state &dest, Move &m, char row, int col, char current_player)
-{
-    m.type = 'm';
-    m.torow = row;
-    m.tocol = (short)col;
-
-    std::string key;
-    key.push_back(current_player);
-    key.push_back(' ');
-    size_t pos = dest.s.find(key);
-    if (pos == std::string::npos)
-        return false;
+/* closest_valid_point
+ - Free in-bounds cell closest to the target (row, col) among those within `s` steps of (cp_row, cp_col).
+ - Scans rings of growing distance around the target, starting with the nearest one the budget can
+   reach; a ring meets the board in at most two cells per row, and only rows inside the player's
+   diamond are visited, so the cost depends on the board height rather than on the stamina.
+ - On a ring, rows nearer the target row come first (the walk approaches rows first), then the
+   row and column on the player's side.
+ - Returns the player's own (occupied) cell when no free cell is reachable.
+ */
+static cell closest_valid_point(int row, int col, int cp_row, int cp_col, int s, const game_state &gs, int H, int W)
+{
+    int rlo = std::max(0, cp_row - s), rhi = std::min(H - 1, cp_row + s);
+    int toward_r = (cp_row >= row) ? 1 : -1;
+    int toward_c = (cp_col >= col) ? 1 : -1;
+    int dist = distance_rc(row, col, cp_row, cp_col);
 
-    size_t start = pos + 2;
-    size_t end = start;
-    while (end < dest.s.size() && dest.s[end] != ' ')
-        ++end;
+    int dr_min = (row < rlo) ? rlo - row : (row > rhi) ? row - rhi : 0; // row distance to the diamond's rows
+    int dr_lim = std::max(row - rlo, rhi - row);
 
-    std::string repl;
-    repl.push_back(row);
-    repl += std::to_string(col);
+    for (int d = std::max(0, dist - s); d <= dist + s; ++d)
+    {
+        int dr_max = std::min(d, dr_lim);
+        for (int dr = dr_min; dr <= dr_max; ++dr)
+        {
+            for (int rs = 0; rs < (dr ? 2 : 1); ++rs)
+            {
+                int r = row + (rs ? -toward_r : toward_r) * dr;
+                if (r < rlo || r > rhi)
+                    continue;
+                int dc = d - dr;
+                int budget = s - (r > cp_row ? r - cp_row : cp_row - r); // column steps left on this row
+                for (int cs = 0; cs < (dc ? 2 : 1); ++cs)
+                {
+                    int c = col + (cs ? -toward_c : toward_c) * dc;
+                    if (c < 1 || c > W || (c > cp_col ? c - cp_col : cp_col - c) > budget || occupied(gs, r, c))
+                        continue;
+                    cell p = {(unsigned char)r, (unsigned char)c};
+                    return p;
+                }
+            }
+        }
+    }
 
-    dest.s.replace(start, end - start, repl);
+    cell self = {(unsigned char)cp_row, (unsigned char)cp_col};
+    return self;
+}
 
-    return true;
+/* end_round_state
+ - Append a 'pass' action (end-of-turn/no-op successor) as out[n++]. */
+static inline void end_round_state(action *out, int &n)
+{
+    action &a = out[n++];
+    a.move.type = 'p';
+    a.move.torow = '.';
+    a.move.tocol = 0;
+    a.cost = 0;
+    a.item = -1;
+    a.monster = -1;
 }
 
-/* next_states
- - Generate successor game states for the player `current_player`.
- - Produces moves, attacks, pickups, and pass states.
- - Ensures string updates are applied before storing each successor. */
-int next_states(int H, int W, const game_state &gs, char current_player, const std::vector<item> &items,
-                std::vector<game_state> &ngs, std::vector<Move> &moves)
+/* push_action
+ - Append a move ('m') or attack ('a') on (row, col) costing `cost` stamina as out[n++]. */
+template <int BC>
+static inline void push_action(action *out, int &n, char type, int row, int col, int cost, int item_slot = -1,
+                               int monster_slot = -1)
 {
-    ngs.clear();
-    moves.clear();
-    ngs.resize(30);
-    moves.resize(30);
+    action &a = out[n++];
+    a.move.type = type;
+    a.move.torow = row_char<BC>(row);
+    a.move.tocol = (short)col;
+    a.cost = (short)cost;
+    a.item = (signed char)item_slot;
+    a.monster = (signed char)monster_slot;
+}
 
+/* generate_actions
+ - Generate the actions available to side CP: moves, attacks, pickups, and pass.
+ - Order and content match the successors of next_states; nothing is applied to gs.
+ - out must have room for MAX_SUCCESSORS actions: at most max(4, items + monsters + 2) + 1 are produced. */
+template <int CP, int BC> static int generate_actions_t(int H, int W, const game_state &gs, action *out)
+{
     int state = 0;
-    int cp = (current_player == 'A') ? 0 : 1;
-    int op = 1 - cp;
-    char opp_char = (current_player == 'A') ? 'B' : 'A';
-    if (gs.players[cp].s == 0)
+    const int cp = CP;
+    const int op = 1 - CP;
+    int s = gs.players[cp].s;
+    if (s == 0)
     {
-        end_round_state(ngs[state], gs, moves[state], cp, op);
-        return 1;
+        end_round_state(out, state);
+        return state;
     }
 
-    size_t cp_pos = gs.s.find(std::string(1, current_player) + " ");
-    if (cp_pos == std::string::npos)
-    {
-        end_round_state(ngs[state], gs, moves[state], cp, op);
-        return 1;
-    }
-    int tmp = (int)cp_pos + 2;
-    char cp_row = getrow(gs.s, tmp);
-    int cp_col = getcol(gs.s, tmp);
-
-    int o = 0, m = 0;
-    for (int i = 0; i < (int)gs.s.size(); ++i)
-    {
-        if (gs.s[i] == 'm' && i + 1 < (int)gs.s.size() && gs.s[i + 1] == ' ')
-            ++m;
-        if (isobject_index(i, gs.s))
-            ++o;
-    }
+    int cp_row = gs.pos[cp].row;
+    int cp_col = gs.pos[cp].col;
+    int opp_row = gs.pos[op].row;
+    int opp_col = gs.pos[op].col;
 
-    size_t opp_pos = gs.s.find(std::string(1, opp_char) + " ");
-    if (opp_pos == std::string::npos)
-    {
-        end_round_state(ngs[state], gs, moves[state], cp, op);
-        return 1;
-    }
-    tmp = (int)opp_pos + 2;
-    char opp_row = getrow(gs.s, tmp);
-    int opp_col = getcol(gs.s, tmp);
+    int o = __builtin_popcount(gs.item_alive);
+    int m = __builtin_popcount(gs.monster_alive);
 
     int dtop = distance_rc(opp_row, opp_col, cp_row, cp_col);
 
     if (dtop == 1)
     {
-        if (gs.players[cp].s >= 10)
-        {
-            Move mm;
-            mm.type = 'a';
-            mm.torow = opp_row;
-            mm.tocol = (short)opp_col;
-            ngs[state] = gs;
-            short damage = std::max<short>(0, gs.players[cp].A - gs.players[op].D);
-            ngs[state].players[op].H = (short)(gs.players[op].H - damage);
-            ngs[state].players[cp].s = (short)(gs.players[cp].s - 10);
-            moves[state] = mm;
-            ++state;
-        }
+        if (s >= 10)
+            push_action<BC>(out, state, 'a', opp_row, opp_col, 10);
         else
         {
             int di[] = {-1, 1, -1, 1};
             int dj[] = {-1, 1, 1, -1};
             for (int dir = 0; dir < 4; ++dir)
             {
-                char nr = (char)(opp_row + di[dir]);
+                int nr = opp_row + di[dir];
                 int nc = opp_col + dj[dir];
-                if (nr == 'Z' + 1)
-                    nr = 'a';
-                if (nr == 'a' - 1)
-                    nr = 'Z';
-                int ri = rowCharToIndex(nr);
-                bool in_bounds = (ri >= 0 && ri < H && nc > 0 && nc <= W);
-                bool not_occupied = true;
-                if (in_bounds)
-                {
-                    std::string sub;
-                    sub.push_back(nr);
-                    if (nc > 9)
-                        sub.push_back(char('0' + (nc / 10) % 10));
-                    sub.push_back(char('0' + (nc % 10)));
-                    not_occupied = (gs.s.find(sub) == std::string::npos);
-                }
-                if (in_bounds && not_occupied)
+                bool in_bounds = (nr >= 0 && nr < H && nc > 0 && nc <= W);
+                if (in_bounds && !occupied(gs, nr, nc))
                 {
                     int dist = distance_rc(nr, nc, cp_row, cp_col);
-                    if (dist <= gs.players[cp].s)
+                    if (dist <= s)
                     {
-                        Move mm;
-                        game_state dest = gs;
-                        if (move_player_apply(dest, mm, nr, nc, current_player))
-                        {
-                            dest.players[cp].s = (short)(gs.players[cp].s - dist);
-                            ngs[state] = std::move(dest);
-                            mm.type = 'm';
-                            moves[state] = mm;
-                            ++state;
-                            break;
-                        }
+                        push_action<BC>(out, state, 'm', nr, nc, dist);
+                        break;
                     }
                 }
             }
@@ -455,383 +553,1017 @@ int next_states(int H, int W, const game_state &gs, char current_player, const s
         int dj[] = {1, -1, 0, 0};
         for (int dir = 0; dir < 4; ++dir)
         {
-            char nr = (char)(opp_row + di[dir]);
+            int nr = opp_row + di[dir];
             int nc = opp_col + dj[dir];
-            if (nr == 'Z' + 1)
-                nr = 'a';
-            if (nr == 'a' - 1)
-                nr = 'Z';
-            int ri = rowCharToIndex(nr);
-            bool in_bounds = (ri >= 0 && ri < H && nc > 0 && nc <= W);
-            bool not_occupied = true;
-            if (in_bounds)
-            {
-                std::string sub;
-                sub.push_back(nr);
-                if (nc > 9)
-                    sub.push_back(char('0' + (nc / 10) % 10));
-                sub.push_back(char('0' + (nc % 10)));
-                not_occupied = (gs.s.find(sub) == std::string::npos);
-            }
-            if (in_bounds && not_occupied)
+            bool in_bounds = (nr >= 0 && nr < H && nc > 0 && nc <= W);
+            if (in_bounds && !occupied(gs, nr, nc))
             {
                 int dist = distance_rc(nr, nc, cp_row, cp_col);
-                if (dist + 10 <= gs.players[cp].s)
+                if (dist + 10 <= s)
                 {
-                    Move mm;
-                    game_state dest = gs;
-                    if (move_player_apply(dest, mm, nr, nc, current_player))
-                    {
-                        dest.players[cp].s = (short)(gs.players[cp].s - dist);
-                        ngs[state] = std::move(dest);
-                        mm.type = 'm';
-                        moves[state] = mm;
-                        ++state;
-                        break;
-                    }
+                    push_action<BC>(out, state, 'm', nr, nc, dist);
+                    break;
                 }
-                else if (dtop - 1 > gs.players[cp].s)
+                else if (dtop - 1 > s)
                 {
-                    point closest = closest_valid_point(nr, nc, cp_row, cp_col, gs.players[cp].s, gs.s, H, W);
+                    cell closest = closest_valid_point(nr, nc, cp_row, cp_col, s, gs, H, W);
                     int d = distance_rc(closest.row, closest.col, cp_row, cp_col);
-                    std::string sub;
-                    sub.push_back(closest.row);
-                    if (closest.col > 9)
-                        sub.push_back(char('0' + (closest.col / 10) % 10));
-                    sub.push_back(char('0' + (closest.col % 10)));
-                    bool val = (gs.s.find(sub) == std::string::npos);
-                    if (val && d <= gs.players[cp].s)
-                    {
-                        Move mm;
-                        game_state dest = gs;
-                        if (move_player_apply(dest, mm, closest.row, closest.col, current_player))
-                        {
-                            dest.players[cp].s = 0;
-                            ngs[state] = std::move(dest);
-                            mm.type = 'm';
-                            moves[state] = mm;
-                            ++state;
-                        }
-                    }
+                    if (!occupied(gs, closest.row, closest.col) && d <= s)
+                        push_action<BC>(out, state, 'm', closest.row, closest.col, s); // stops short: spends everything
                     else
-                    {
-                        end_round_state(ngs[state], gs, moves[state], cp, op);
-                        ++state;
-                    }
+                        end_round_state(out, state);
                 }
                 else
                 {
-                    end_round_state(ngs[state], gs, moves[state], cp, op);
-                    ++state;
+                    end_round_state(out, state);
                     break;
                 }
             }
         }
     }
 
-    int i = 0;
-    while (state <= o + 1)
+    for (int k = 0; k < gs.n_items && state <= o + 1; ++k)
     {
-        while (i < (int)gs.s.size() && !isobject_index(i, gs.s))
-            ++i;
-        if (i >= (int)gs.s.size())
-            break;
-        int nr_o = (int)(gs.s[i + 1] - '0');
-        i += 3;
-        int start = i - 3, end = i + 1;
-        while (end - 1 < (int)gs.s.size() && gs.s[end - 1] != ' ' && gs.s[end - 1] != '\0')
-            ++end;
-        char orow = getrow(gs.s, i);
-        int ocol = getcol(gs.s, i);
+        if (!(gs.item_alive >> k & 1u))
+            continue;
+        int orow = gs.item_pos[k].row;
+        int ocol = gs.item_pos[k].col;
         int dist = distance_rc(orow, ocol, cp_row, cp_col);
-        if (dist <= gs.players[cp].s)
-        {
-            game_state dest = gs;
-            if (delete_c(dest.s, start, end - start) == -1)
-                return -1;
-            Move mm;
-            mm.type = 'm';
-            mm.torow = orow;
-            mm.tocol = (short)ocol;
-            if (!move_player_apply(dest, mm, orow, ocol, current_player))
-                return -1;
-            dest.players[cp].s = (short)(gs.players[cp].s - dist);
-            dest.players[cp].H = (short)(gs.players[cp].H + items[nr_o].dH);
-            dest.players[cp].A = (short)(gs.players[cp].A + items[nr_o].dA);
-            dest.players[cp].D = (short)(gs.players[cp].D + items[nr_o].dD);
-            dest.players[cp].S = (short)(gs.players[cp].S + items[nr_o].dS);
-            ngs[state] = std::move(dest);
-            moves[state] = mm;
-        }
+        if (dist <= s)
+            push_action<BC>(out, state, 'm', orow, ocol, dist, k);
         else
         {
-            point closest = closest_valid_point(orow, ocol, cp_row, cp_col, gs.players[cp].s, gs.s, H, W);
-            std::string sub;
-            sub.push_back(closest.row);
-            if (closest.col > 9)
-                sub.push_back(char('0' + (closest.col / 10) % 10));
-            sub.push_back(char('0' + (closest.col % 10)));
-            if (gs.s.find(sub) == std::string::npos)
-            {
-                Move mm;
-                game_state dest = gs;
-                if (move_player_apply(dest, mm, closest.row, closest.col, current_player))
-                {
-                    dest.players[cp].s = 0;
-                    ngs[state] = std::move(dest);
-                    moves[state] = mm;
-                }
-            }
+            cell closest = closest_valid_point(orow, ocol, cp_row, cp_col, s, gs, H, W);
+            if (!occupied(gs, closest.row, closest.col))
+                push_action<BC>(out, state, 'm', closest.row, closest.col, s);
             else
-            {
-                end_round_state(ngs[state], gs, moves[state], cp, op);
-            }
+                end_round_state(out, state);
         }
-        ++state;
     }
 
-    i = 0;
-    while (state <= o + m + 1)
+    for (int k = 0; k < gs.n_monsters && state <= o + m + 1; ++k)
     {
-        while (i < (int)gs.s.size() && !(gs.s[i] == 'm' && i + 1 < (int)gs.s.size() && gs.s[i + 1] == ' '))
-            ++i;
-        if (i >= (int)gs.s.size())
-            break;
-        i += 2;
-        int start = i - 2, end = i + 1;
-        while (end - 1 < (int)gs.s.size() && gs.s[end - 1] != ' ' && gs.s[end - 1] != '\0')
-            ++end;
-        char mrow = getrow(gs.s, i);
-        int mcol = getcol(gs.s, i);
+        if (!(gs.monster_alive >> k & 1u))
+            continue;
+        int mrow = gs.monster_pos[k].row;
+        int mcol = gs.monster_pos[k].col;
         int dtom = distance_rc(mrow, mcol, cp_row, cp_col);
-        if (dtom == 1 && gs.players[cp].s >= 10)
-        {
-            game_state dest = gs;
-            if (delete_c(dest.s, start, end - start) == -1)
-                return -1;
-            Move mm;
-            mm.type = 'a';
-            mm.torow = mrow;
-            mm.tocol = (short)mcol;
-            dest.players[cp].s = (short)(gs.players[cp].s - 10);
-            dest.players[cp].H = (short)(gs.players[cp].H + 10);
-            ngs[state] = std::move(dest);
-            moves[state] = mm;
-            ++state;
-        }
+        if (dtom == 1 && s >= 10)
+            push_action<BC>(out, state, 'a', mrow, mcol, 10, -1, k);
         else
         {
             int di[] = {0, 0, 1, -1};
             int dj[] = {1, -1, 0, 0};
-            bool progressed = false;
             for (int dir = 0; dir < 4; ++dir)
             {
-                char nr = (char)(mrow + di[dir]);
+                int nr = mrow + di[dir];
                 int nc = mcol + dj[dir];
-                if (nr == 'Z' + 1)
-                    nr = 'a';
-                if (nr == 'a' - 1)
-                    nr = 'Z';
-                int ri = rowCharToIndex(nr);
-                bool in_bounds = (ri >= 0 && ri < H && nc > 0 && nc <= W);
-                std::string sub;
-                sub.push_back(nr);
-                if (nc > 9)
-                    sub.push_back(char('0' + (nc / 10) % 10));
-                sub.push_back(char('0' + (nc % 10)));
-                if (in_bounds && gs.s.find(sub) == std::string::npos)
+                bool in_bounds = (nr >= 0 && nr < H && nc > 0 && nc <= W);
+                if (in_bounds && !occupied(gs, nr, nc))
                 {
                     int dist = distance_rc(nr, nc, cp_row, cp_col);
-                    if (dist <= gs.players[cp].s)
+                    if (dist <= s)
                     {
-                        Move mm;
-                        game_state dest = gs;
-                        if (move_player_apply(dest, mm, nr, nc, current_player))
-                        {
-                            dest.players[cp].s = (short)(gs.players[cp].s - dist);
-                            ngs[state] = std::move(dest);
-                            moves[state] = mm;
-                            ++state;
-                            progressed = true;
-                            break;
-                        }
+                        push_action<BC>(out, state, 'm', nr, nc, dist);
+                        break;
                     }
-                    else if (dtom > gs.players[cp].s)
+                    else if (dtom > s)
                     {
-                        point closest = closest_valid_point(nr, nc, cp_row, cp_col, gs.players[cp].s, gs.s, H, W);
-                        std::string subs;
-                        subs.push_back(closest.row);
-                        if (closest.col > 9)
-                            subs.push_back(char('0' + (closest.col / 10) % 10));
-                        subs.push_back(char('0' + (closest.col % 10)));
-                        if (gs.s.find(subs) == std::string::npos)
-                        {
-                            Move mm;
-                            game_state dest = gs;
-                            if (move_player_apply(dest, mm, closest.row, closest.col, current_player))
-                            {
-                                dest.players[cp].s = 0;
-                                ngs[state] = std::move(dest);
-                                moves[state] = mm;
-                            }
-                        }
+                        cell closest = closest_valid_point(nr, nc, cp_row, cp_col, s, gs, H, W);
+                        if (!occupied(gs, closest.row, closest.col))
+                            push_action<BC>(out, state, 'm', closest.row, closest.col, s);
                         else
-                        {
-                            end_round_state(ngs[state], gs, moves[state], cp, op);
-                        }
-                        ++state;
-                        progressed = true;
+                            end_round_state(out, state);
                         break;
                     }
                 }
             }
-            (void)progressed;
         }
     }
 
-    end_round_state(ngs[state], gs, moves[state], cp, op);
-    ++state;
-    ngs.resize(state);
-    moves.resize(state);
+    end_round_state(out, state);
     return state;
 }
 
-/* game_over_check
- - Terminal test: either player's health <= 0 indicates game over. */
-static inline bool game_over_check(const game_state &gs)
+int generate_actions(int H, int W, const game_state &gs, char current_player, action *out)
 {
-    return gs.players[0].H <= 0 || gs.players[1].H <= 0;
+    int cp = (current_player == 'A') ? 0 : 1;
+    if (board_class_of(H) == BOARD_SMALL)
+        return cp ? generate_actions_t<1, BOARD_SMALL>(H, W, gs, out) : generate_actions_t<0, BOARD_SMALL>(H, W, gs, out);
+    return cp ? generate_actions_t<1, BOARD_FULL>(H, W, gs, out) : generate_actions_t<0, BOARD_FULL>(H, W, gs, out);
 }
 
-/* static_eval
- - Heuristic evaluation from perspective of root_player.
- - Returns +/-INF for decisive terminal states; otherwise a linear stat difference. */
-static int static_eval(const game_state &gs, char root_player)
+/* make_move
+ - Apply action a for side CP to gs in place, recording in u what is needed to revert it.
+ - Updates stats, stamina, coordinates, occupancy, item/monster alive flags and the hash. */
+template <int CP, int BC>
+static inline void make_move_t(game_state &gs, const action &a, const std::vector<item> &items, move_undo &u)
 {
-    int p = (root_player == 'A') ? 0 : 1;
-    int o = 1 - p;
+    const int cp = CP;
+    const int op = 1 - CP;
+    u.players[0] = gs.players[0];
+    u.players[1] = gs.players[1];
+    u.from = gs.pos[cp];
+    u.hash = gs.hash;
 
-    if (game_over_check(gs) && gs.players[p].H > 0)
-        return INF;
-    if (game_over_check(gs) && gs.players[p].H <= 0)
-        return -INF;
+    if (a.move.type == 'p')
+        return;
+
+    unsigned long long h = gs.hash ^ player_key(cp, gs.players[cp], gs.pos[cp]);
+    player &me = gs.players[cp];
+    me.s = (short)(me.s - a.cost);
 
-    int dmg_p = std::max(1, gs.players[p].A - gs.players[o].D);
-    int dmg_o = std::max(1, gs.players[o].A - gs.players[p].D);
+    if (a.move.type == 'a')
+    {
+        if (a.monster >= 0)
+        {
+            cell mc = gs.monster_pos[a.monster];
+            gs.monster_alive &= ~(1u << a.monster);
+            occ_clear(gs, mc.row, mc.col);
+            h ^= monster_key(mc);
+            me.H = (short)(me.H + 10);
+        }
+        else
+        {
+            player &opp = gs.players[op];
+            h ^= player_key(op, opp, gs.pos[op]);
+            short damage = std::max<short>(0, me.A - opp.D);
+            opp.H = (short)(opp.H - damage);
+            h ^= player_key(op, opp, gs.pos[op]);
+        }
+    }
+    else
+    {
+        if (a.item >= 0)
+        {
+            const item &it = items[gs.item_id[a.item]];
+            gs.item_alive &= (unsigned short)~(1u << a.item);
+            h ^= item_key(gs.item_id[a.item], gs.item_pos[a.item]);
+            me.H = (short)(me.H + it.dH);
+            me.A = (short)(me.A + it.dA);
+            me.D = (short)(me.D + it.dD);
+            me.S = (short)(me.S + it.dS);
+        }
+        int row = row_index<BC>(a.move.torow);
+        occ_clear(gs, gs.pos[cp].row, gs.pos[cp].col);
+        occ_set(gs, row, a.move.tocol);
+        gs.pos[cp].row = (unsigned char)row;
+        gs.pos[cp].col = (unsigned char)a.move.tocol;
+    }
 
-    int turns_to_kill_o = (gs.players[o].H + dmg_p - 1) / dmg_p;
-    int turns_to_kill_p = (gs.players[p].H + dmg_o - 1) / dmg_o;
+    gs.hash = h ^ player_key(cp, me, gs.pos[cp]);
+}
 
-    int tempo_score = (turns_to_kill_p - turns_to_kill_o) * 100;
+/* unmake_move
+ - Revert make_move exactly, using the record it filled. */
+template <int CP> static inline void unmake_move_t(game_state &gs, const action &a, const move_undo &u)
+{
+    const int cp = CP;
+    gs.players[0] = u.players[0];
+    gs.players[1] = u.players[1];
+    gs.hash = u.hash;
 
-    int stat_score =
-        gs.players[p].H + gs.players[p].A + gs.players[p].D + gs.players[p].S -
-        (gs.players[o].H + gs.players[o].A + gs.players[o].D + gs.players[o].S);
+    if (a.move.type == 'm')
+    {
+        occ_clear(gs, gs.pos[cp].row, gs.pos[cp].col);
+        occ_set(gs, u.from.row, u.from.col);
+        gs.pos[cp] = u.from;
+        if (a.item >= 0)
+        {
+            gs.item_alive |= (unsigned short)(1u << a.item);
+            occ_set(gs, gs.item_pos[a.item].row, gs.item_pos[a.item].col);
+        }
+    }
+    else if (a.move.type == 'a' && a.monster >= 0)
+    {
+        gs.monster_alive |= 1u << a.monster;
+        occ_set(gs, gs.monster_pos[a.monster].row, gs.monster_pos[a.monster].col);
+    }
+}
 
-    return tempo_score + stat_score;
+void make_move(game_state &gs, const action &a, char current_player, const std::vector<item> &items, move_undo &u)
+{
+    // the board size is not known here; the full class converts any row
+    if (current_player == 'A')
+        make_move_t<0, BOARD_FULL>(gs, a, items, u);
+    else
+        make_move_t<1, BOARD_FULL>(gs, a, items, u);
 }
 
-/* close_game_eval
- - Evaluates a position when the game is forced to end due to too many consecutive passes.
- - The winner is decided by comparing the overall stats of both players.
- - Returns +INF if the root_player has the advantage, otherwise -INF. */
-static int close_game_eval(const game_state &gs, char root_player){
-    int p = (root_player == 'A') ? 0 : 1;
-    int o = 1 - p;
+void unmake_move(game_state &gs, const action &a, char current_player, const move_undo &u)
+{
+    if (current_player == 'A')
+        unmake_move_t<0>(gs, a, u);
+    else
+        unmake_move_t<1>(gs, a, u);
+}
 
-    int stat_score =
-        gs.players[p].H + gs.players[p].A + gs.players[p].D + gs.players[p].S -
-        (gs.players[o].H + gs.players[o].A + gs.players[o].D + gs.players[o].S);
+/* next_states
+ - Generate successor game states for the player `current_player`.
+ - Produces moves, attacks, pickups, and pass states (one copy of gs per action). */
+template <int CP, int BC>
+static int next_states_t(int H, int W, const game_state &gs, const std::vector<item> &items,
+                         std::vector<game_state> &ngs, std::vector<Move> &moves)
+{
+    action acts[MAX_SUCCESSORS];
+    int n = generate_actions_t<CP, BC>(H, W, gs, acts);
 
-    if(stat_score > 0){
-        return INF;
+    ngs.assign(n, gs);
+    moves.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        move_undo u;
+        make_move_t<CP, BC>(ngs[i], acts[i], items, u);
+        moves[i] = acts[i].move;
     }
-    return -INF;
+    return n;
+}
 
+int next_states(int H, int W, const game_state &gs, char current_player, const std::vector<item> &items,
+                std::vector<game_state> &ngs, std::vector<Move> &moves)
+{
+    int cp = (current_player == 'A') ? 0 : 1;
+    if (board_class_of(H) == BOARD_SMALL)
+        return cp ? next_states_t<1, BOARD_SMALL>(H, W, gs, items, ngs, moves)
+                  : next_states_t<0, BOARD_SMALL>(H, W, gs, items, ngs, moves);
+    return cp ? next_states_t<1, BOARD_FULL>(H, W, gs, items, ngs, moves)
+              : next_states_t<0, BOARD_FULL>(H, W, gs, items, ngs, moves);
 }
 
-/* minimax_search
- - Depth-limited minimax with alpha-beta pruning.
- - current_player is the player to move at this node; root_player is the evaluation perspective.
- - Respects move types and stamina to decide depth progression. */
-static int minimax_search(const game_state &gs, int depth, char current_player, char root_player, int H, int W,
-                          const std::vector<item> &items, int &alpha, int &beta, int consecutivePasses, int &maxpasses)
+/* game_over_check
+ - Terminal test: either player's health <= 0 indicates game over. */
+static inline bool game_over_check(const game_state &gs)
 {
-    if(consecutivePasses >= maxpasses){
-        return close_game_eval(gs, root_player);
-    }
+    return gs.players[0].H <= 0 || gs.players[1].H <= 0;
+}
 
-    if (depth == 0 || game_over_check(gs))
-        return static_eval(gs, root_player);
+/* eval_terms
+ - static_eval of a game still in progress from the stats of player p and opponent o: the difference
+   in turns each needs to kill the other, and the stat difference. Shared with the batch kernels. */
+static inline int eval_terms(int Hp, int Ap, int Dp, int Sp, int Ho, int Ao, int Do, int So)
+{
+    int dmg_p = std::max(1, Ap - Do);
+    int dmg_o = std::max(1, Ao - Dp);
 
-    std::vector<game_state> ngs;
-    std::vector<Move> moves;
+    int turns_to_kill_o = (Ho + dmg_p - 1) / dmg_p;
+    int turns_to_kill_p = (Hp + dmg_o - 1) / dmg_o;
 
-    int nStates = next_states(H, W, gs, current_player, items, ngs, moves);
+    int tempo_score = (turns_to_kill_p - turns_to_kill_o) * 100;
 
-    if (nStates == 0)
-        return static_eval(gs, root_player);
+    int stat_score = Hp + Ap + Dp + Sp - (Ho + Ao + Do + So);
 
-    bool maximizing = (current_player == root_player);
+    return tempo_score + stat_score;
+}
 
-    if (maximizing)
+/* static_eval
+ - Heuristic evaluation from perspective of root_player.
+ - Returns +/-INF for decisive terminal states; otherwise a linear stat difference. */
+int static_eval(const game_state &gs, char root_player)
+{
+    int p = (root_player == 'A') ? 0 : 1;
+    int o = 1 - p;
+
+    if (game_over_check(gs) && gs.players[p].H > 0)
+        return INF;
+    if (game_over_check(gs) && gs.players[p].H <= 0)
+        return -INF;
+
+    const player &me = gs.players[p], &opp = gs.players[o];
+    return eval_terms(me.H, me.A, me.D, me.S, opp.H, opp.A, opp.D, opp.S);
+}
+
+void eval_batch::add(const game_state &gs)
+{
+    for (int p = 0; p < 2; ++p)
+    {
+        H[p][n] = gs.players[p].H;
+        A[p][n] = gs.players[p].A;
+        D[p][n] = gs.players[p].D;
+        S[p][n] = gs.players[p].S;
+    }
+    ++n;
+}
+
+/* eval_lanes_scalar
+ - static_eval on the batch layout for lanes [from, b.n): the fallback and the tail of the vector kernels. */
+static void eval_lanes_scalar(const eval_batch &b, int p, int from, int *out)
+{
+    int o = 1 - p;
+    for (int i = from; i < b.n; ++i)
     {
-        int max_eval = -INF;
+        if (b.H[p][i] <= 0 || b.H[o][i] <= 0)
+            out[i] = b.H[p][i] > 0 ? INF : -INF;
+        else
+            out[i] = eval_terms(b.H[p][i], b.A[p][i], b.D[p][i], b.S[p][i], b.H[o][i], b.A[o][i], b.D[o][i], b.S[o][i]);
+    }
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+/* Vector kernels
+ - Stats are shorts, so every intermediate (health + damage, turns * 100, stat sums) is an integer
+   below 2^24 and exact in float. The turns_to_kill divisions become a reciprocal estimate refined by
+   one Newton step; the quotient is then corrected by one either way, which makes it exact.
+ - Finished games are blended to +/-INF at the end, as static_eval returns them. */
+
+/* turns_sse / turns_avx2
+ - ceil(h / dmg) per lane, for h >= 1 and dmg >= 1. */
+static inline __m128 turns_sse(__m128 h, __m128 dmg)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 n = _mm_sub_ps(_mm_add_ps(h, dmg), one);
+    __m128 r = _mm_rcp_ps(dmg);
+    r = _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(2.0f), _mm_mul_ps(dmg, r)));
+    __m128 q = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(n, r)));
+    q = _mm_sub_ps(q, _mm_and_ps(_mm_cmpgt_ps(_mm_mul_ps(q, dmg), n), one));
+    return _mm_add_ps(q, _mm_and_ps(_mm_cmple_ps(_mm_mul_ps(_mm_add_ps(q, one), dmg), n), one));
+}
+
+__attribute__((target("avx2"))) static inline __m256 turns_avx2(__m256 h, __m256 dmg)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 n = _mm256_sub_ps(_mm256_add_ps(h, dmg), one);
+    __m256 r = _mm256_rcp_ps(dmg);
+    r = _mm256_mul_ps(r, _mm256_sub_ps(_mm256_set1_ps(2.0f), _mm256_mul_ps(dmg, r)));
+    __m256 q = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_mul_ps(n, r)));
+    q = _mm256_sub_ps(q, _mm256_and_ps(_mm256_cmp_ps(_mm256_mul_ps(q, dmg), n, _CMP_GT_OQ), one));
+    return _mm256_add_ps(q, _mm256_and_ps(_mm256_cmp_ps(_mm256_mul_ps(_mm256_add_ps(q, one), dmg), n, _CMP_LE_OQ), one));
+}
+
+static inline __m128 load_sse(const int *v)
+{
+    return _mm_cvtepi32_ps(_mm_load_si128((const __m128i *)v));
+}
+
+__attribute__((target("avx2"))) static inline __m256 load_avx2(const int *v)
+{
+    return _mm256_cvtepi32_ps(_mm256_load_si256((const __m256i *)v));
+}
+
+static void eval_lanes_sse(const eval_batch &b, int p, int *out)
+{
+    int o = 1 - p, i = 0;
+    const __m128 one = _mm_set1_ps(1.0f), hundred = _mm_set1_ps(100.0f), zero = _mm_setzero_ps();
+    const __m128i win = _mm_set1_epi32(INF), loss = _mm_set1_epi32(-INF);
+    for (; i + 4 <= b.n; i += 4)
+    {
+        __m128 hp = load_sse(&b.H[p][i]), ap = load_sse(&b.A[p][i]), dp = load_sse(&b.D[p][i]), sp = load_sse(&b.S[p][i]);
+        __m128 ho = load_sse(&b.H[o][i]), ao = load_sse(&b.A[o][i]), dq = load_sse(&b.D[o][i]), so = load_sse(&b.S[o][i]);
+        __m128 tk_o = turns_sse(ho, _mm_max_ps(one, _mm_sub_ps(ap, dq)));
+        __m128 tk_p = turns_sse(hp, _mm_max_ps(one, _mm_sub_ps(ao, dp)));
+        __m128 stats = _mm_sub_ps(_mm_add_ps(_mm_add_ps(hp, ap), _mm_add_ps(dp, sp)),
+                                  _mm_add_ps(_mm_add_ps(ho, ao), _mm_add_ps(dq, so)));
+        __m128i score = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(tk_p, tk_o), hundred), stats));
+
+        __m128i alive = _mm_castps_si128(_mm_cmpgt_ps(hp, zero));
+        __m128i over = _mm_castps_si128(_mm_or_ps(_mm_cmple_ps(hp, zero), _mm_cmple_ps(ho, zero)));
+        __m128i decided = _mm_or_si128(_mm_and_si128(alive, win), _mm_andnot_si128(alive, loss));
+        _mm_storeu_si128((__m128i *)&out[i], _mm_or_si128(_mm_and_si128(over, decided), _mm_andnot_si128(over, score)));
+    }
+    eval_lanes_scalar(b, p, i, out);
+}
+
+__attribute__((target("avx2"))) static void eval_lanes_avx2(const eval_batch &b, int p, int *out)
+{
+    int o = 1 - p, i = 0;
+    const __m256 one = _mm256_set1_ps(1.0f), hundred = _mm256_set1_ps(100.0f), zero = _mm256_setzero_ps();
+    const __m256i win = _mm256_set1_epi32(INF), loss = _mm256_set1_epi32(-INF);
+    for (; i + 8 <= b.n; i += 8)
+    {
+        __m256 hp = load_avx2(&b.H[p][i]), ap = load_avx2(&b.A[p][i]), dp = load_avx2(&b.D[p][i]), sp = load_avx2(&b.S[p][i]);
+        __m256 ho = load_avx2(&b.H[o][i]), ao = load_avx2(&b.A[o][i]), dq = load_avx2(&b.D[o][i]), so = load_avx2(&b.S[o][i]);
+        __m256 tk_o = turns_avx2(ho, _mm256_max_ps(one, _mm256_sub_ps(ap, dq)));
+        __m256 tk_p = turns_avx2(hp, _mm256_max_ps(one, _mm256_sub_ps(ao, dp)));
+        __m256 stats = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(hp, ap), _mm256_add_ps(dp, sp)),
+                                     _mm256_add_ps(_mm256_add_ps(ho, ao), _mm256_add_ps(dq, so)));
+        __m256i score = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(tk_p, tk_o), hundred), stats));
+
+        __m256i alive = _mm256_castps_si256(_mm256_cmp_ps(hp, zero, _CMP_GT_OQ));
+        __m256i over = _mm256_castps_si256(
+            _mm256_or_ps(_mm256_cmp_ps(hp, zero, _CMP_LE_OQ), _mm256_cmp_ps(ho, zero, _CMP_LE_OQ)));
+        __m256i decided = _mm256_blendv_epi8(loss, win, alive);
+        _mm256_storeu_si256((__m256i *)&out[i], _mm256_blendv_epi8(score, decided, over));
+    }
+    // leave no dirty upper halves behind for the SSE code that runs next (the compiler drops its own
+    // vzeroupper before the tail call)
+    _mm256_zeroupper();
+    eval_lanes_scalar(b, p, i, out);
+}
+#endif
+
+/* static_eval_batch
+ - static_eval of every position of the batch: AVX2 or SSE2 kernels where the CPU has them, the scalar
+   lanes elsewhere. */
+void static_eval_batch(const eval_batch &b, char root_player, int *out)
+{
+    int p = (root_player == 'A') ? 0 : 1;
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2)
+        eval_lanes_avx2(b, p, out);
+    else
+        eval_lanes_sse(b, p, out);
+#else
+    eval_lanes_scalar(b, p, 0, out);
+#endif
+}
 
-        for (int i = 0; i < nStates; ++i)
+/* close_game_eval
+ - Evaluates a position when the game is forced to end due to too many consecutive passes.
+ - The winner is decided by comparing the overall stats of both players.
+ - Returns +INF if the root_player has the advantage, otherwise -INF. */
+static int close_game_eval(const game_state &gs, char root_player){
+    int p = (root_player == 'A') ? 0 : 1;
+    int o = 1 - p;
+
+    int stat_score =
+        gs.players[p].H + gs.players[p].A + gs.players[p].D + gs.players[p].S -
+        (gs.players[o].H + gs.players[o].A + gs.players[o].D + gs.players[o].S);
+
+    if(stat_score > 0){
+        return INF;
+    }
+    return -INF;
+
+}
+
+/* TranspositionTable
+ - Data word layout: score (32 bits) | depth (8) | bound (2) | move type (2) | move row (6) | move col (7).
+ - Buckets hold two entries: the first keeps the deepest result, the second is always replaced. */
+TranspositionTable::TranspositionTable(size_t mb)
+{
+    resize(mb);
+}
+
+void TranspositionTable::resize(size_t mb)
+{
+    size_t want = mb * 1024 * 1024 / sizeof(entry);
+    count = 0;
+    if (want >= 2)
+    {
+        count = 1;
+        while (count * 2 <= want)
+            count *= 2;
+    }
+    table.reset(count ? new entry[count] : nullptr);
+}
+
+void TranspositionTable::clear()
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        table[i].check.store(0, std::memory_order_relaxed);
+        table[i].data.store(0, std::memory_order_relaxed);
+    }
+}
+
+static inline unsigned long long tt_pack(const tt_data &d)
+{
+    int type = d.move.type == 'm' ? 1 : d.move.type == 'a' ? 2 : d.move.type == 'p' ? 3 : 0;
+    int row = type == 1 || type == 2 ? rowCharToIndex(d.move.torow) : 0;
+    int col = type == 1 || type == 2 ? d.move.tocol : 0;
+    int depth = std::min(std::max(d.depth, 0), 255);
+    return (unsigned long long)(unsigned int)d.score | (unsigned long long)depth << 32 |
+           (unsigned long long)(d.bound & 3) << 40 | (unsigned long long)type << 42 | (unsigned long long)row << 44 |
+           (unsigned long long)col << 50;
+}
+
+static inline tt_data tt_unpack(unsigned long long v)
+{
+    tt_data d;
+    d.score = (int)(unsigned int)(v & 0xFFFFFFFFULL);
+    d.depth = (int)(v >> 32 & 0xFF);
+    d.bound = (int)(v >> 40 & 3);
+    int type = (int)(v >> 42 & 3);
+    d.move.type = "\0map"[type];
+    d.move.torow = type == 1 || type == 2 ? indexToRowChar((int)(v >> 44 & 63)) : '.';
+    d.move.tocol = (short)(v >> 50 & 127);
+    return d;
+}
+
+bool TranspositionTable::probe(unsigned long long key, tt_data &out) const
+{
+    if (!count)
+        return false;
+    const entry *bucket = &table[key & (count - 2)];
+    for (int i = 0; i < 2; ++i)
+    {
+        unsigned long long data = bucket[i].data.load(std::memory_order_relaxed);
+        unsigned long long check = bucket[i].check.load(std::memory_order_relaxed);
+        if ((check ^ data) == key && (data >> 40 & 3) != TT_NONE)
         {
-            char next_player = current_player;
+            out = tt_unpack(data);
+            return true;
+        }
+    }
+    return false;
+}
 
-            if (moves[i].type == 'p'){
-                next_player = (current_player == 'A') ? 'B' : 'A';
-                consecutivePasses++;
-            }
-            else{
-                consecutivePasses = 0;
-            }
+void TranspositionTable::store(unsigned long long key, const tt_data &d)
+{
+    if (!count)
+        return;
+    entry *bucket = &table[key & (count - 2)];
+    unsigned long long data0 = bucket[0].data.load(std::memory_order_relaxed);
+    unsigned long long check0 = bucket[0].check.load(std::memory_order_relaxed);
+    int depth0 = (int)(data0 >> 32 & 0xFF);
+    entry &e = ((check0 ^ data0) == key || d.depth >= depth0) ? bucket[0] : bucket[1];
+
+    unsigned long long data = tt_pack(d);
+    e.check.store(key ^ data, std::memory_order_relaxed);
+    e.data.store(data, std::memory_order_relaxed);
+}
 
-            int next_depth = (moves[i].type == 'p') ? depth - 1 : depth;
+/* ply_frame
+ - Actions generated at one ply of the search, their ordering keys and visiting order.
+ - killers are the last two quiet moves that caused a beta cutoff at this ply. */
+struct ply_frame
+{
+    action acts[MAX_SUCCESSORS];
+    int keys[MAX_SUCCESSORS];
+    unsigned char order[MAX_SUCCESSORS];
+    Move killers[2];
+};
+
+// Move ordering keys: TT move, then attacks by damage, then killers, then history
+const int ORDER_TT = 1 << 30;
+const int ORDER_ATTACK = 1 << 29;
+const int ORDER_KILLER = 1 << 28;
+const int HISTORY_MAX = 1 << 24; // history is halved once an entry reaches this
+
+// Duel oracle: positions without items or monsters are solved exactly (see solve_duel)
+const int DUEL_CACHE_SIZE = 1 << 14; // memo entries per search context
+const int DUEL_BUDGET = 1 << 14;     // solver nodes per oracle call before it gives up
+const int DUEL_MISS_SIZE = 1 << 12;  // remembered oracle calls that gave no answer, per search context
+
+// solve_duel outcomes for root_player
+const int DUEL_LOSS = 0;
+const int DUEL_WIN = 1;
+const int DUEL_OPEN = 2;   // some line reaches the depth horizon undecided
+const int DUEL_ABORT = -1; // node budget spent
+
+struct duel_entry
+{
+    unsigned long long key;
+    unsigned int gen;    // oracle call that stored it; entries of earlier calls count as empty
+    signed char outcome; // DUEL_LOSS, DUEL_WIN or DUEL_OPEN
+};
 
-            int eval = minimax_search(ngs[i], next_depth, next_player, root_player, H, W, items, alpha, beta, consecutivePasses, maxpasses);
+const int INITIAL_PLIES = 256; // frames allocated per thread before the search starts
 
-            max_eval = std::max(max_eval, eval);
-            alpha = std::max(alpha, eval);
+/* search_context
+ - Per-request, per-thread search parameters and buffers shared by every node of one search.
+ - frames is indexed by ply and only grows (a deque, so deeper growth never moves live frames);
+   once it is deep enough the search itself does no heap allocation. */
+struct search_context;
+typedef int (*child_search_fn)(game_state &gs, const action &a, int depth, int alpha, int beta, search_context &ctx);
 
-            if (beta <= alpha)
-                break;
+struct search_context
+{
+    int H, W;
+    const std::vector<item> *items;
+    char root_player;
+    child_search_fn search_child; // search_child_t for the side to move and board class of the request
+    int maxpasses;
+    TranspositionTable *tt;
+    SearchStats *stats;
+
+    int id;                                         // thread index; 0 produces the result, others are helpers
+    bool timed;                                     // a deadline is set
+    std::chrono::steady_clock::time_point deadline; // checked every 1024 nodes
+    std::atomic<bool> *stop;                        // shared by all threads of the request
+    std::atomic<bool> *cancel;                      // EngineOptions::cancel, may be null
+    unsigned long long nodes;
+    bool stopped; // out of time: every pending result is discarded
+
+    std::deque<ply_frame> frames;
+    int ply;
+    int history[2][3][MAX_ROWS][MAX_COLS + 1]; // [side][move type][target row][target col], bumped on cutoffs
+
+    bool quiescence;                    // resolve pending attacks at depth 0 (EngineOptions::quiescence)
+    unsigned long long root_key;        // root_key(root_player, quiescence), mixed into table keys
+    std::vector<duel_entry> duel_cache; // DUEL_CACHE_SIZE entries, private to each oracle call via gen
+    unsigned int duel_gen = 0;
+    int duel_nodes;
+    std::vector<unsigned long long> duel_misses; // DUEL_MISS_SIZE keys of oracle calls without an answer
+};
+
+static inline bool same_move(const Move &a, const Move &b)
+{
+    return a.type == b.type && a.torow == b.torow && a.tocol == b.tocol;
+}
+
+template <int BC> static inline int &history_entry(search_context &ctx, int cp, const Move &m)
+{
+    if (m.type == 'p')
+        return ctx.history[cp][2][0][0];
+    return ctx.history[cp][m.type == 'a' ? 1 : 0][row_index<BC>(m.torow)][m.tocol];
+}
+
+/* order_moves
+ - Fill f.order with the visiting order of f.acts[0..n): the TT move first, then attacks by the damage
+   they deal (A - D against the opponent, the 10 health a monster gives), then this ply's killers,
+   then the rest by history score. Ties keep generation order. */
+template <int CP, int BC>
+static void order_moves(search_context &ctx, ply_frame &f, int n, const game_state &gs, const Move *tt_move)
+{
+    const int cp = CP;
+    for (int i = 0; i < n; ++i)
+    {
+        const action &a = f.acts[i];
+        int key;
+        if (tt_move && same_move(a.move, *tt_move))
+            key = ORDER_TT;
+        else if (a.move.type == 'a')
+            key = ORDER_ATTACK + (a.monster >= 0 ? 10 : std::max(0, gs.players[cp].A - gs.players[1 - cp].D));
+        else if (same_move(a.move, f.killers[0]))
+            key = ORDER_KILLER + 1;
+        else if (same_move(a.move, f.killers[1]))
+            key = ORDER_KILLER;
+        else
+            key = history_entry<BC>(ctx, cp, a.move);
+        f.keys[i] = key;
+
+        int j = i;
+        while (j > 0 && f.keys[f.order[j - 1]] < key)
+        {
+            f.order[j] = f.order[j - 1];
+            --j;
         }
+        f.order[j] = (unsigned char)i;
+    }
+}
+
+/* record_cutoff
+ - A move at this ply refuted the position: remember quiet ones as killers and raise their history. */
+template <int BC> static void record_cutoff(search_context &ctx, ply_frame &f, const action &a, int cp, int depth, bool first)
+{
+    ++ctx.stats->beta_cutoffs;
+    if (first)
+        ++ctx.stats->first_move_cutoffs;
+    if (a.move.type == 'a')
+        return;
+    if (!same_move(a.move, f.killers[0]))
+    {
+        f.killers[1] = f.killers[0];
+        f.killers[0] = a.move;
+    }
+    int &h = history_entry<BC>(ctx, cp, a.move);
+    h += depth * depth + 1;
+    if (h >= HISTORY_MAX)
+    {
+        int *v = &ctx.history[0][0][0][0];
+        for (size_t k = 0; k < sizeof(ctx.history) / sizeof(int); ++k)
+            v[k] /= 2;
+    }
+}
+
+/* out_of_time
+ - Poll the clock every 1024 nodes; once the deadline passes, or the caller cancels, the search unwinds
+   with stopped set.
+ - The first thread to notice raises the shared stop flag for the others. */
+static inline bool out_of_time(search_context &ctx)
+{
+    if (ctx.stopped)
+        return true;
+    ++ctx.nodes;
+    if (ctx.stop->load(std::memory_order_relaxed) || (ctx.cancel && ctx.cancel->load(std::memory_order_relaxed)))
+        ctx.stopped = true;
+    else if (ctx.timed && (ctx.nodes & 1023) == 0 && std::chrono::steady_clock::now() >= ctx.deadline)
+    {
+        ctx.stopped = true;
+        ctx.stop->store(true, std::memory_order_relaxed);
+    }
+    return ctx.stopped;
+}
+
+/* duel_key
+ - Key of a duel node: the table key minimax_search would use, plus the remaining depth, since the
+   solver's horizon is part of its answer. */
+template <int CP> static inline unsigned long long duel_key(const game_state &gs, int depth, int passes, const search_context &ctx)
+{
+    return gs.hash ^ side_key(side_char(CP)) ^ pass_key(passes, ctx.maxpasses) ^ ctx.root_key ^
+           zmix(0x60000000ULL | (unsigned long long)depth);
+}
+
+/* solve_duel
+ - Outcome of a position without items or monsters within the search's own horizon and rules: the
+   moves generate_actions offers, no stamina refill, depth - 1 after a pass, and maxpasses
+   consecutive passes ending the game by close_game_eval. Its leaves are those of minimax_search,
+   so a DUEL_WIN or DUEL_LOSS is exactly the score minimax_search would find by searching on; a
+   line that reaches depth 0 undecided leaves the answer DUEL_OPEN, as the search would score it
+   by quiescence and static_eval there.
+ - Returns DUEL_ABORT once the node budget of the call is spent.
+ - Memoized per oracle call only, so whether a position is solved never depends on earlier searches. */
+template <int CP, int BC> static int solve_duel(game_state &gs, int depth, int passes, search_context &ctx)
+{
+    if (passes >= ctx.maxpasses)
+        return close_game_eval(gs, ctx.root_player) > 0 ? DUEL_WIN : DUEL_LOSS;
+    if (game_over_check(gs))
+        return static_eval(gs, ctx.root_player) > 0 ? DUEL_WIN : DUEL_LOSS;
+    if (depth == 0)
+        return DUEL_OPEN;
+    if (++ctx.duel_nodes > DUEL_BUDGET)
+        return DUEL_ABORT;
+
+    unsigned long long key = duel_key<CP>(gs, depth, passes, ctx);
+    duel_entry &e = ctx.duel_cache[key & (DUEL_CACHE_SIZE - 1)];
+    if (e.gen == ctx.duel_gen && e.key == key)
+        return e.outcome;
+
+    if (ctx.ply >= (int)ctx.frames.size())
+        ctx.frames.emplace_back();
+    action *acts = ctx.frames[ctx.ply].acts;
+    int n = generate_actions_t<CP, BC>(ctx.H, ctx.W, gs, acts);
+
+    // the root player looks for a winning move, the opponent for a losing one; the node is decided
+    // the other way only if every move is
+    int want = side_char(CP) == ctx.root_player ? DUEL_WIN : DUEL_LOSS;
+    int result = want == DUEL_WIN ? DUEL_LOSS : DUEL_WIN;
+    for (int i = 0; i < n && result != want; ++i)
+    {
+        bool pass = acts[i].move.type == 'p';
+        move_undo u;
+        make_move_t<CP, BC>(gs, acts[i], *ctx.items, u);
+        ++ctx.ply;
+        int r = pass ? solve_duel<1 - CP, BC>(gs, depth - 1, passes + 1, ctx) : solve_duel<CP, BC>(gs, depth, 0, ctx);
+        --ctx.ply;
+        unmake_move_t<CP>(gs, acts[i], u);
+        if (r == DUEL_ABORT)
+            return DUEL_ABORT;
+        if (r == want || r == DUEL_OPEN)
+            result = r;
+    }
+
+    e.key = key;
+    e.gen = ctx.duel_gen;
+    e.outcome = (signed char)result;
+    return result;
+}
 
-        return max_eval;
+/* duel_oracle
+ - Exact score (+/-INF) of a position with no items or monsters left when it is decided within the
+   remaining depth; false if it is not, or too big to solve within DUEL_BUDGET nodes, and the search
+   then carries on as usual.
+ - Calls without an answer are remembered by key (the outcome depends on nothing else), so
+   re-searches and later iterations do not pay for the same failed solve again. */
+template <int CP, int BC> static bool duel_oracle(game_state &gs, int depth, int passes, search_context &ctx, int &score)
+{
+    unsigned long long key = duel_key<CP>(gs, depth, passes, ctx);
+    unsigned long long &miss = ctx.duel_misses[key & (DUEL_MISS_SIZE - 1)];
+    if (miss == key)
+        return false;
+    if (++ctx.duel_gen == 0)
+    {
+        for (duel_entry &e : ctx.duel_cache)
+            e.gen = 0;
+        ctx.duel_gen = 1;
+    }
+    ctx.duel_nodes = 0;
+    int r = solve_duel<CP, BC>(gs, depth, passes, ctx);
+    if (r != DUEL_WIN && r != DUEL_LOSS)
+    {
+        miss = key;
+        return false;
     }
+    score = r == DUEL_WIN ? INF : -INF;
+    return true;
+}
+
+/* quiescence
+ - Horizon node: the side to move may stand pat on static_eval (as if it passed) or play one of its
+   attacks, on the opponent or on a monster, and go on. Only attacks are searched, and each costs 10
+   stamina, so the extension is short; it keeps a leaf from being scored in the middle of a
+   pending exchange.
+ - Fail-soft alpha-beta like minimax_search, without the transposition table. */
+template <int CP, int BC> static int quiescence(game_state &gs, int alpha, int beta, search_context &ctx)
+{
+    if (out_of_time(ctx))
+        return 0;
+    ++ctx.stats->quiescence_nodes;
+    if (ctx.ply >= ctx.stats->max_ply)
+        ctx.stats->max_ply = ctx.ply + 1;
+
+    ++ctx.stats->leaf_evals;
+    int best_eval = static_eval(gs, ctx.root_player);
+    bool maximizing = (side_char(CP) == ctx.root_player);
+    if (game_over_check(gs) || (maximizing ? best_eval >= beta : best_eval <= alpha))
+        return best_eval;
+    if (gs.players[CP].s < 10) // no attack is affordable
+        return best_eval;
+    if (maximizing)
+        alpha = std::max(alpha, best_eval);
     else
+        beta = std::min(beta, best_eval);
+
+    if (ctx.ply >= (int)ctx.frames.size())
+        ctx.frames.emplace_back();
+    action *acts = ctx.frames[ctx.ply].acts;
+    int n = generate_actions_t<CP, BC>(ctx.H, ctx.W, gs, acts);
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (acts[i].move.type != 'a')
+            continue;
+        move_undo u;
+        make_move_t<CP, BC>(gs, acts[i], *ctx.items, u);
+        ++ctx.ply;
+        int eval = quiescence<CP, BC>(gs, alpha, beta, ctx);
+        --ctx.ply;
+        unmake_move_t<CP>(gs, acts[i], u);
+        if (ctx.stopped)
+            return 0;
+
+        if (maximizing)
+        {
+            best_eval = std::max(best_eval, eval);
+            alpha = std::max(alpha, eval);
+        }
+        else
+        {
+            best_eval = std::min(best_eval, eval);
+            beta = std::min(beta, eval);
+        }
+        if (beta <= alpha)
+            break;
+    }
+    return best_eval;
+}
+
+template <int CP, int BC>
+static int minimax_search(game_state &gs, int depth, int alpha, int beta, int consecutivePasses, search_context &ctx);
+
+// The side to move is part of the instantiation: after a pass the search continues in the other side's.
+template <int CP, int BC>
+static inline int minimax_child(game_state &gs, bool pass, int depth, int alpha, int beta, int passes,
+                                search_context &ctx)
+{
+    return pass ? minimax_search<1 - CP, BC>(gs, depth, alpha, beta, passes, ctx)
+                : minimax_search<CP, BC>(gs, depth, alpha, beta, passes, ctx);
+}
+
+/* minimax_search
+ - Depth-limited minimax with fail-soft alpha-beta pruning; the (alpha, beta) window is passed by value.
+ - Principal Variation Search: after the first child, siblings get a null window and are searched
+   again with the full window only if they land inside it.
+ - CP is the side to move at this node (0 = A) and BC its board class; root_player is the evaluation
+   perspective. A pass continues in the other side's instantiation.
+ - Respects move types and stamina to decide depth progression.
+ - Once no items or monsters are left, duel_oracle answers exactly when the outcome is decided within
+   the remaining depth, and the node is not expanded.
+ - At depth 0 the leaf goes through quiescence, which plays out pending attacks before evaluating.
+ - Results are cached in the transposition table relative to the side to move, keyed on the root too.
+ - Children are visited in order_moves order; Lazy SMP helpers (ctx.id > 0) rotate that order
+   so threads spread over the tree.
+ - Children are applied to gs with make_move and reverted with unmake_move; gs is unchanged on return. */
+template <int CP, int BC>
+static int minimax_search(game_state &gs, int depth, int alpha, int beta, int consecutivePasses, search_context &ctx)
+{
+    if (out_of_time(ctx))
+        return 0;
+    if (ctx.ply >= ctx.stats->max_ply)
+        ctx.stats->max_ply = ctx.ply + 1;
+
+    if(consecutivePasses >= ctx.maxpasses){
+        ++ctx.stats->pass_limit;
+        return close_game_eval(gs, ctx.root_player);
+    }
+
+    if (game_over_check(gs))
     {
-        int min_eval = INF;
+        ++ctx.stats->leaf_evals;
+        return static_eval(gs, ctx.root_player);
+    }
 
-        for (int i = 0; i < nStates; ++i)
+    // nothing left to collect or kill: the rest is a duel with an exact answer
+    int solved;
+    if (depth > 0 && !gs.item_alive && !gs.monster_alive && duel_oracle<CP, BC>(gs, depth, consecutivePasses, ctx, solved))
+    {
+        ++ctx.stats->duel_solved;
+        return solved;
+    }
+
+    if (depth == 0)
+    {
+        if (ctx.quiescence)
+            return quiescence<CP, BC>(gs, alpha, beta, ctx);
+        ++ctx.stats->leaf_evals;
+        return static_eval(gs, ctx.root_player);
+    }
+
+    bool maximizing = (side_char(CP) == ctx.root_player);
+    unsigned long long key =
+        gs.hash ^ side_key(side_char(CP)) ^ pass_key(consecutivePasses, ctx.maxpasses) ^ ctx.root_key;
+
+    tt_data hit;
+    const Move *tt_move = nullptr;
+    if (ctx.tt->probe(key, hit))
+    {
+        ++ctx.stats->tt_hits;
+        tt_move = &hit.move;
+        // only same-depth results are reused, so the score never depends on what earlier
+        // requests or other threads happened to leave in the table
+        if (hit.depth == depth)
         {
-            char next_player = current_player;
+            int v = maximizing ? hit.score : -hit.score;
+            int bound = hit.bound;
+            if (!maximizing && bound != TT_EXACT)
+                bound = (bound == TT_LOWER) ? TT_UPPER : TT_LOWER;
+            if (bound == TT_EXACT || (bound == TT_LOWER && v >= beta) || (bound == TT_UPPER && v <= alpha))
+                return v;
+        }
+    }
+    else if (ctx.tt->entries())
+    {
+        ++ctx.stats->tt_misses;
+    }
 
-            if (moves[i].type == 'p'){
-                next_player = (current_player == 'A') ? 'B' : 'A';
-                consecutivePasses++;
-            }
-            else{
-                consecutivePasses = 0;
-            }
+    if (ctx.ply >= (int)ctx.frames.size())
+        ctx.frames.emplace_back();
+    ply_frame &f = ctx.frames[ctx.ply];
+    action *acts = f.acts;
+
+    int nStates = generate_actions_t<CP, BC>(ctx.H, ctx.W, gs, acts);
+    ++ctx.stats->expanded;
+    ctx.stats->successors += nStates;
+
+    if (nStates == 0)
+    {
+        ++ctx.stats->leaf_evals;
+        return static_eval(gs, ctx.root_player);
+    }
 
-            int next_depth = (moves[i].type == 'p') ? depth - 1 : depth;
+    order_moves<CP, BC>(ctx, f, nStates, gs, tt_move);
 
-            int eval = minimax_search(ngs[i], next_depth, next_player, root_player, H, W, items, alpha, beta, consecutivePasses, maxpasses);
+    int alpha0 = alpha, beta0 = beta;
+    int best_eval = maximizing ? -INF : INF;
+    int best_index = 0;
 
-            min_eval = std::min(min_eval, eval);
-            beta = std::min(beta, eval);
+    int shift = ctx.id ? (int)(((gs.hash >> 40) + (unsigned long long)ctx.id) % (unsigned long long)nStates) : 0;
 
-            if (beta <= alpha)
-                break;
+    for (int k = 0; k < nStates; ++k)
+    {
+        int i = f.order[(k + shift) % nStates];
+        bool pass = acts[i].move.type == 'p';
+        int next_passes = pass ? consecutivePasses + 1 : 0;
+        int next_depth = pass ? depth - 1 : depth;
+
+        move_undo u;
+        make_move_t<CP, BC>(gs, acts[i], *ctx.items, u);
+        ++ctx.ply;
+        int eval;
+        if (k == 0)
+            eval = minimax_child<CP, BC>(gs, pass, next_depth, alpha, beta, next_passes, ctx);
+        else
+        {
+            int lo = maximizing ? alpha : beta - 1;
+            eval = minimax_child<CP, BC>(gs, pass, next_depth, lo, lo + 1, next_passes, ctx);
+            if (eval > alpha && eval < beta)
+                eval = minimax_child<CP, BC>(gs, pass, next_depth, alpha, beta, next_passes, ctx);
+        }
+        --ctx.ply;
+        unmake_move_t<CP>(gs, acts[i], u);
+        if (ctx.stopped)
+            return 0;
+
+        if (maximizing)
+        {
+            if (eval > best_eval)
+            {
+                best_eval = eval;
+                best_index = i;
+            }
+            alpha = std::max(alpha, eval);
+        }
+        else
+        {
+            if (eval < best_eval)
+            {
+                best_eval = eval;
+                best_index = i;
+            }
+            beta = std::min(beta, eval);
         }
 
-        return min_eval;
+        if (beta <= alpha)
+        {
+            record_cutoff<BC>(ctx, f, acts[i], CP, depth, k == 0);
+            break;
+        }
     }
+
+    tt_data d;
+    d.score = maximizing ? best_eval : -best_eval;
+    d.depth = depth;
+    d.move = acts[best_index].move;
+    if (best_eval <= alpha0)
+        d.bound = maximizing ? TT_UPPER : TT_LOWER;
+    else if (best_eval >= beta0)
+        d.bound = maximizing ? TT_LOWER : TT_UPPER;
+    else
+        d.bound = TT_EXACT;
+    ctx.tt->store(key, d);
+
+    return best_eval;
 }
 
 EngineResult best_move(const char* file_name)
@@ -843,7 +1575,7 @@ EngineResult best_move(const char* file_name)
         m.type = 'p';
         m.torow = '.';
         m.tocol = 0;
-        return {m, -INF, 0};
+        return {m, -INF, 0, SearchStats()};
     }
 
     return best_move_from_stream(fin);
@@ -859,69 +1591,884 @@ double score_to_chance(int score) // sigmoid function
     return 1.0 / (1.0 + std::exp(-score / K));
 }
 
+/* mcts_node / mcts_tree
+ - Node pool of the Monte Carlo search, allocated once and reused by later requests of a session.
+ - The children of a node are one contiguous block, claimed with a single fetch_add on `used`, so an
+   expansion never allocates and threads never lock. */
+enum mcts_node_state
+{
+    MCTS_LEAF = 0,      // not expanded yet
+    MCTS_EXPANDING = 1, // one thread is filling in the children; the others treat it as a leaf
+    MCTS_EXPANDED = 2,
+    MCTS_FULL = 3       // the pool ran out when it was to be expanded; stays a leaf
+};
+
+struct mcts_node
+{
+    action act;                           // move from the parent position
+    std::atomic<int> visits;              // playouts through the node, including those still running
+    std::atomic<long long> wins;          // reward of the side that played act, MCTS_SCALE per won playout
+    std::atomic<unsigned char> state;     // mcts_node_state
+    unsigned char n_children;             // valid once state is MCTS_EXPANDED
+    int prior;                            // static_eval after act for the side that played it (mcts_priors)
+    unsigned int first_child;
+};
+
+struct mcts_tree
+{
+    std::unique_ptr<mcts_node[]> nodes;
+    size_t capacity = 0;
+    std::atomic<size_t> used{0};
+
+    void reset(size_t n)
+    {
+        if (n != capacity)
+        {
+            nodes.reset(new mcts_node[n]);
+            capacity = n;
+        }
+        used = 0;
+    }
+
+    // first index of k fresh nodes, or capacity if the pool is exhausted
+    size_t claim(size_t k)
+    {
+        size_t i = used.fetch_add(k, std::memory_order_relaxed);
+        if (i + k > capacity)
+            return capacity;
+        for (size_t j = i; j < i + k; ++j)
+        {
+            nodes[j].visits.store(0, std::memory_order_relaxed);
+            nodes[j].wins.store(0, std::memory_order_relaxed);
+            nodes[j].state.store(MCTS_LEAF, std::memory_order_relaxed);
+            nodes[j].n_children = 0;
+            nodes[j].first_child = 0;
+            nodes[j].prior = 0;
+        }
+        return i;
+    }
+};
+
+SearchSession::SearchSession(size_t tt_mb) : tt(tt_mb) {}
+
+SearchSession::~SearchSession() = default;
+
+/* default_table
+ - Process-wide table used when the caller does not supply one; created on first use. */
+static TranspositionTable &default_table()
+{
+    static TranspositionTable tt(16);
+    return tt;
+}
+
+/* search_pool
+ - Helper threads kept by the thread that searches, parked on a condition variable between jobs,
+   so iterations, aspiration re-searches and later requests reuse them instead of starting threads.
+ - run(threads, fn, arg) calls fn(arg, t) on helper t for t = 1..threads-1 and fn(arg, 0) on the
+   caller, and returns once all calls are done. Helpers are started on first need and kept. */
+class search_pool
+{
+public:
+    ~search_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread &th : helpers)
+            th.join();
+    }
+
+    void run(int threads, void (*fn)(void *, int), void *arg)
+    {
+        if (threads <= 1)
+        {
+            fn(arg, 0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m);
+            while ((int)helpers.size() < threads - 1)
+                helpers.emplace_back(&search_pool::helper, this, (int)helpers.size() + 1, generation);
+            job = fn;
+            job_arg = arg;
+            job_threads = threads;
+            running = threads - 1;
+            ++generation;
+        }
+        wake.notify_all();
+        fn(arg, 0);
+        std::unique_lock<std::mutex> lock(m);
+        finished.wait(lock, [&] { return running == 0; });
+    }
+
+private:
+    void helper(int id, unsigned long long seen)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        for (;;)
+        {
+            wake.wait(lock, [&] { return quit || generation != seen; });
+            if (quit)
+                return;
+            seen = generation;
+            if (id >= job_threads)
+                continue; // this job uses fewer threads
+            void (*fn)(void *, int) = job;
+            void *arg = job_arg;
+            lock.unlock();
+            fn(arg, id);
+            lock.lock();
+            if (--running == 0)
+                finished.notify_one();
+        }
+    }
+
+    std::mutex m;
+    std::condition_variable wake, finished;
+    std::vector<std::thread> helpers;
+    void (*job)(void *, int) = nullptr;
+    void *job_arg = nullptr;
+    int job_threads = 0;                // helpers with a smaller id take part in the current job
+    int running = 0;                    // helpers still working on it
+    unsigned long long generation = 0;  // bumped for every job
+    bool quit = false;
+};
+
+static search_pool &thread_pool()
+{
+    static thread_local search_pool pool;
+    return pool;
+}
+
+/* search_child
+ - Search the position after root action a, handing the turn over on a pass as minimax_search does.
+ - One instantiation per side to move and board class; root_child_search picks it once per request. */
+template <int CP, int BC>
+static int search_child_t(game_state &gs, const action &a, int depth, int alpha, int beta, search_context &ctx)
+{
+    move_undo u;
+    make_move_t<CP, BC>(gs, a, *ctx.items, u);
+    int score;
+    if (a.move.type == 'p')
+        score = minimax_search<1 - CP, BC>(gs, depth - 1, alpha, beta, 1, ctx);
+    else
+        score = minimax_search<CP, BC>(gs, depth, alpha, beta, 0, ctx);
+    unmake_move_t<CP>(gs, a, u);
+    return score;
+}
+
+static child_search_fn root_child_search(char current_player, int H)
+{
+    int cp = (current_player == 'A') ? 0 : 1;
+    if (board_class_of(H) == BOARD_SMALL)
+        return cp ? search_child_t<1, BOARD_SMALL> : search_child_t<0, BOARD_SMALL>;
+    return cp ? search_child_t<1, BOARD_FULL> : search_child_t<0, BOARD_FULL>;
+}
+
+/* root_worker
+ - Take root moves from `next` (visiting order[(k + shift) % n]) until none are left.
+ - Workers sharing `best` first test later children with a null window just below the best exact
+   score so far and search them again only if they reach it, so ties stay exact and the pick does
+   not depend on timing.
+ - (lo, hi) is the aspiration window; scores outside it are only bounds.
+ - scores/done may be null for Lazy SMP helpers, whose only output is the transposition table. */
+static void root_worker(const game_state &root, const std::vector<action> &acts, const std::vector<int> &order,
+                        int depth, int lo, int hi, search_context &ctx, std::atomic<int> &next,
+                        std::atomic<int> &best, int shift, std::vector<int> *scores, std::vector<char> *done)
+{
+    int n = (int)order.size();
+    ctx.maxpasses = std::min(depth, 10);
+    ctx.ply = 0;
+    game_state gs = root; // this thread's working position
+#ifdef GCAE_COUNT_ALLOCS
+    unsigned long long allocs_before = alloc_count;
+#endif
+    for (int k = next++; k < n; k = next++)
+    {
+        int i = order[(k + shift) % n];
+        int bound = best.load();
+        if (bound >= hi)
+            break; // the iteration fails high and is searched again with a wider window
+        int alpha = std::max(lo, (bound > -INF) ? bound - 1 : -INF);
+        int score;
+        if (alpha > lo)
+        {
+            score = ctx.search_child(gs, acts[i], depth, alpha, alpha + 1, ctx);
+            if (score > alpha && !ctx.stopped)
+                score = ctx.search_child(gs, acts[i], depth, alpha, hi, ctx);
+        }
+        else
+            score = ctx.search_child(gs, acts[i], depth, alpha, hi, ctx);
+        if (ctx.stopped)
+            break;
+        if (scores)
+        {
+            (*scores)[i] = score;
+            (*done)[i] = 1;
+        }
+        while (score > bound && !best.compare_exchange_weak(bound, score))
+        {
+        }
+    }
+#ifdef GCAE_COUNT_ALLOCS
+    ctx.stats->allocations += alloc_count - allocs_before;
+#endif
+}
+
+/* root_job
+ - One search_root call as handed to the thread pool. */
+struct root_job
+{
+    const game_state *root;
+    const std::vector<action> *acts;
+    const std::vector<int> *order;
+    int depth, lo, hi;
+    search_context *ctxs;
+    bool lazy_smp;
+    std::atomic<int> next{0};
+    std::atomic<int> best{-INF};
+    std::atomic<bool> helpers_stop{false};
+    std::vector<int> *scores;
+    std::vector<char> *done;
+};
+
+static void run_root_job(void *arg, int t)
+{
+    root_job &j = *static_cast<root_job *>(arg);
+    if (t > 0 && j.lazy_smp)
+    {
+        std::atomic<int> own_next(0);
+        std::atomic<int> own_best(-INF);
+        root_worker(*j.root, *j.acts, *j.order, j.depth, j.lo, j.hi, j.ctxs[t], own_next, own_best, t, nullptr,
+                    nullptr);
+        return;
+    }
+    root_worker(*j.root, *j.acts, *j.order, j.depth, j.lo, j.hi, j.ctxs[t], j.next, j.best, 0, j.scores, j.done);
+    if (t == 0)
+        j.helpers_stop.store(true);
+}
+
+/* search_root
+ - Score the root successors at `depth` with one worker per context, inside the window (lo, hi).
+ - Root splitting: all workers share one queue of root moves.
+ - Lazy SMP: every helper searches the whole root on its own, starting from a different move,
+   and only feeds the shared table; ctxs[0] alone produces the scores and helpers stop when it is done.
+ - Either way the scores do not depend on thread timing: a table hit is only taken at its own depth,
+   and entries are keyed on the root (root_key), so a helper's entry holds what ctxs[0] would compute.
+ - The workers are the calling thread and its pooled helpers (search_pool).
+ - Returns false if the deadline interrupted the iteration; scores of finished children are kept. */
+static bool search_root(const game_state &root, const std::vector<action> &acts, const std::vector<int> &order, int depth,
+                        int lo, int hi, search_context *ctxs, int threads, bool lazy_smp,
+                        std::vector<int> &scores, std::vector<char> &done)
+{
+    root_job job;
+    job.root = &root;
+    job.acts = &acts;
+    job.order = &order;
+    job.depth = depth;
+    job.lo = lo;
+    job.hi = hi;
+    job.ctxs = ctxs;
+    job.lazy_smp = lazy_smp;
+    job.scores = &scores;
+    job.done = &done;
+    if (lazy_smp)
+        for (int t = 1; t < threads; ++t)
+        {
+            ctxs[t].stop = &job.helpers_stop;
+            ctxs[t].stopped = false;
+        }
+    thread_pool().run(threads, run_root_job, &job);
+
+    if (lazy_smp)
+    {
+        for (int t = 1; t < threads; ++t)
+            ctxs[t].stop = ctxs[0].stop;
+        return !ctxs[0].stopped;
+    }
+    for (int t = 0; t < threads; ++t)
+        if (ctxs[t].stopped)
+            return false;
+    return true;
+}
+
 /* best_move
  - Parse input file, run next_states + minimax, return best Move.
- - current_player is the player that must act now. */
+ - current_player is the player that must act now.
+ - Header line: H W next_player depth [movetime_ms]. */
 EngineResult best_move_from_stream(std::istream& fin)
 {
-    EngineResult nullRes = {{'p', '.', 0}, -INF, 0};
+    return best_move_from_stream(fin, EngineOptions());
+}
 
-    int H, W, depth;
-    char current_player;
-    fin >> H >> W >> current_player >> depth;
-    if (!fin)
-        return nullRes;
+/* read_request
+ - Parse one text request; the search itself only ever sees the parsed form. */
+bool read_request(std::istream& fin, position_request& req)
+{
+    std::string header;
+    while (header.find_first_not_of(" \t\r") == std::string::npos)
+        if (!std::getline(fin, header))
+            return false;
 
-    game_state gs;
+    std::istringstream hs(header);
+    hs >> req.H >> req.W >> req.player >> req.depth;
+    if (!hs || req.H < 1 || req.H > MAX_ROWS || req.W < 1 || req.W > MAX_COLS)
+        return false;
+    if (!(hs >> req.movetime_ms))
+        req.movetime_ms = -1;
+
+    game_state &gs = req.gs;
     fin >> gs.players[0].H >> gs.players[0].A >> gs.players[0].D >> gs.players[0].s >> gs.players[0].S;
     fin >> gs.players[1].H >> gs.players[1].A >> gs.players[1].D >> gs.players[1].s >> gs.players[1].S;
 
     int n;
     fin >> n;
-    std::vector<item> items(n);
+    if (!fin || n < 0 || n > MAX_ITEMS)
+        return false;
+    req.items.resize(n);
     for (int i = 0; i < n; ++i)
     {
-        fin >> items[i].dH >> items[i].dA >> items[i].dD >> items[i].dS;
+        fin >> req.items[i].dH >> req.items[i].dA >> req.items[i].dD >> req.items[i].dS;
     }
 
-    std::string rest;
+    std::string rest, encoded;
     std::getline(fin, rest); // eat endline
-    std::getline(fin, gs.s);
+    std::getline(fin, encoded);
+
+    if (!encoded.empty() && encoded.back() == '\r')
+        encoded.pop_back();
+
+    if (!decode_state(req.H, req.W, encoded, gs))
+        return false;
+    for (int k = 0; k < gs.n_items; ++k)
+        if (gs.item_id[k] >= n)
+            return false;
+    return true;
+}
+
+EngineResult best_move_from_stream(std::istream& fin, const EngineOptions& opt)
+{
+    position_request req;
+    if (!read_request(fin, req))
+        return {{'p', '.', 0}, -INF, 0, SearchStats()};
+    return best_move_from_request(req, opt);
+}
+
+// Monte Carlo Tree Search (EngineOptions::algorithm == ALGO_MCTS)
+const int MCTS_ROLLOUT_MOVES = 48;   // rollout moves before the position is scored by static_eval
+const int MCTS_MAX_PATH = 256;       // deepest tree line followed by one playout
+const double MCTS_EXPLORATION = 0.7; // UCT constant; rewards are in [0, 1]
+const long long MCTS_SCALE = 1 << 16; // fixed-point unit of mcts_node::wins
+
+struct mcts_rng
+{
+    unsigned long long s;
+    unsigned long long next() { return zmix(s += 0x9E3779B97F4A7C15ULL); }
+};
+
+/* mcts_search
+ - What the playout threads of one request share. */
+struct mcts_search
+{
+    mcts_tree *tree;
+    const game_state *root;
+    int root_cp;
+    int H, W;
+    const std::vector<item> *items;
+    bool timed;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> *cancel;
+    std::atomic<bool> stop{false};
+    std::atomic<int> playouts_left{0}; // untimed budget
+};
+
+/* mcts_play
+ - Apply a for side cp under the README turn rules: the round ends on a pass or when the mover is out
+   of stamina, and the other side then starts its round with full stamina. Unlike minimax_search,
+   which looks at the current round only, playouts go on over later rounds. */
+template <int BC>
+static inline void mcts_play(game_state &gs, const action &a, int &cp, const std::vector<item> &items)
+{
+    move_undo u;
+    if (cp)
+        make_move_t<1, BC>(gs, a, items, u);
+    else
+        make_move_t<0, BC>(gs, a, items, u);
+    if (a.move.type == 'p' || gs.players[cp].s <= 0)
+    {
+        cp = 1 - cp;
+        gs.players[cp].s = gs.players[cp].S;
+    }
+}
+
+template <int BC> static inline int mcts_actions(int H, int W, const game_state &gs, int cp, action *out)
+{
+    return cp ? generate_actions_t<1, BC>(H, W, gs, out) : generate_actions_t<0, BC>(H, W, gs, out);
+}
+
+/* mcts_priors
+ - Fill in the children of a node being expanded from gs, where side cp plays acts[0..n): the
+   actions, and as priors the static_eval of every position they lead to, for cp, scored in one
+   static_eval_batch call. gs is unchanged on return. */
+template <int BC>
+static void mcts_priors(game_state &gs, int cp, const action *acts, int n, const std::vector<item> &items,
+                        mcts_node *children)
+{
+    eval_batch batch;
+    for (int i = 0; i < n; ++i)
+    {
+        move_undo u;
+        if (cp)
+        {
+            make_move_t<1, BC>(gs, acts[i], items, u);
+            batch.add(gs);
+            unmake_move_t<1>(gs, acts[i], u);
+        }
+        else
+        {
+            make_move_t<0, BC>(gs, acts[i], items, u);
+            batch.add(gs);
+            unmake_move_t<0>(gs, acts[i], u);
+        }
+    }
+    int scores[EVAL_BATCH_MAX];
+    static_eval_batch(batch, side_char(cp), scores);
+    for (int i = 0; i < n; ++i)
+    {
+        children[i].act = acts[i];
+        children[i].prior = scores[i];
+    }
+}
+
+/* mcts_rollout
+ - Play on from gs with the cheap rollout policy (an attack when there is one, otherwise a random
+   action of generate_actions) and return the reward of the root side: 1 or 0 once a player is down,
+   the static_eval win chance after MCTS_ROLLOUT_MOVES moves. */
+template <int BC>
+static double mcts_rollout(const mcts_search &ms, game_state &gs, int cp, mcts_rng &rng, SearchStats &stats)
+{
+    char root_player = ms.root_cp ? 'B' : 'A';
+    action acts[MAX_SUCCESSORS];
+    for (int m = 0; m < MCTS_ROLLOUT_MOVES && !game_over_check(gs); ++m)
+    {
+        int n = mcts_actions<BC>(ms.H, ms.W, gs, cp, acts);
+        int pick = -1;
+        for (int i = 0; i < n && pick < 0; ++i)
+            if (acts[i].move.type == 'a')
+                pick = i;
+        if (pick < 0)
+            pick = (int)(rng.next() % (unsigned long long)n);
+        mcts_play<BC>(gs, acts[pick], cp, *ms.items);
+    }
+    if (game_over_check(gs))
+        return static_eval(gs, root_player) > 0 ? 1.0 : 0.0;
+    ++stats.leaf_evals;
+    return score_to_chance(static_eval(gs, root_player));
+}
+
+/* mcts_select
+ - UCT child of an expanded node for the side to move there: unvisited children first, best prior
+   first (generation order among equal ones), then the best wins/visits + MCTS_EXPLORATION *
+   sqrt(ln N / visits). Visits of playouts still running count as losses (virtual loss), which
+   spreads the threads over the tree. */
+static unsigned mcts_select(const mcts_tree &t, const mcts_node &node)
+{
+    double log_n = std::log((double)std::max(1, node.visits.load(std::memory_order_relaxed)));
+    unsigned best = node.first_child;
+    double best_u = -1;
+    unsigned fresh = 0; // best unvisited child + 1, 0 while there is none
+    for (unsigned c = node.first_child; c < node.first_child + node.n_children; ++c)
+    {
+        int n = t.nodes[c].visits.load(std::memory_order_relaxed);
+        if (n == 0)
+        {
+            if (!fresh || t.nodes[c].prior > t.nodes[fresh - 1].prior)
+                fresh = c + 1;
+            continue;
+        }
+        if (fresh)
+            continue;
+        double q = (double)t.nodes[c].wins.load(std::memory_order_relaxed) / ((double)MCTS_SCALE * n);
+        double u = q + MCTS_EXPLORATION * std::sqrt(log_n / n);
+        if (u > best_u)
+        {
+            best_u = u;
+            best = c;
+        }
+    }
+    return fresh ? fresh - 1 : best;
+}
+
+/* mcts_worker
+ - Run playouts until the budget is spent: select down the tree applying the moves to a copy of the
+   root, expand the leaf reached once it has been visited before, roll out, and back the reward up. */
+template <int BC> static void mcts_worker(mcts_search &ms, int id, SearchStats &stats)
+{
+    mcts_tree &t = *ms.tree;
+    mcts_rng rng = {ms.root->hash ^ (0x9E3779B97F4A7C15ULL * (unsigned long long)(id + 1))};
+    unsigned path[MCTS_MAX_PATH];
+    int mover[MCTS_MAX_PATH];
+    action acts[MAX_SUCCESSORS];
+    for (unsigned long long k = 0;; ++k)
+    {
+        if (ms.stop.load(std::memory_order_relaxed) || (ms.cancel && ms.cancel->load(std::memory_order_relaxed)))
+            break;
+        if (ms.timed ? (k & 63) == 0 && std::chrono::steady_clock::now() >= ms.deadline
+                     : ms.playouts_left.fetch_sub(1, std::memory_order_relaxed) <= 0)
+        {
+            ms.stop.store(true, std::memory_order_relaxed);
+            break;
+        }
+
+        game_state gs = *ms.root;
+        int cp = ms.root_cp;
+        int len = 0;
+        unsigned node = 0;
+        path[len++] = 0;
+        t.nodes[0].visits.fetch_add(1, std::memory_order_relaxed);
+        while (len < MCTS_MAX_PATH && !game_over_check(gs) &&
+               t.nodes[node].state.load(std::memory_order_acquire) == MCTS_EXPANDED)
+        {
+            node = mcts_select(t, t.nodes[node]);
+            t.nodes[node].visits.fetch_add(1, std::memory_order_relaxed); // virtual loss until backed up
+            mover[len] = cp;
+            path[len++] = node;
+            mcts_play<BC>(gs, t.nodes[node].act, cp, *ms.items);
+        }
+        if (len > stats.max_ply)
+            stats.max_ply = len;
+
+        // a leaf is expanded on its second visit, so one-off lines do not use up the pool
+        mcts_node &leaf = t.nodes[node];
+        unsigned char expect = MCTS_LEAF;
+        if (!game_over_check(gs) && leaf.visits.load(std::memory_order_relaxed) > 1 &&
+            leaf.state.compare_exchange_strong(expect, MCTS_EXPANDING, std::memory_order_acquire))
+        {
+            int n = mcts_actions<BC>(ms.H, ms.W, gs, cp, acts);
+            size_t first = t.claim((size_t)n);
+            if (first == t.capacity)
+                leaf.state.store(MCTS_FULL, std::memory_order_relaxed);
+            else
+            {
+                mcts_priors<BC>(gs, cp, acts, n, *ms.items, &t.nodes[first]);
+                leaf.first_child = (unsigned)first;
+                leaf.n_children = (unsigned char)n;
+                leaf.state.store(MCTS_EXPANDED, std::memory_order_release);
+                ++stats.expanded;
+                stats.successors += n;
+            }
+        }
+
+        double reward = mcts_rollout<BC>(ms, gs, cp, rng, stats);
+        ++stats.nodes;
+        long long won = (long long)(reward * MCTS_SCALE + 0.5);
+        for (int i = 1; i < len; ++i)
+            t.nodes[path[i]].wins.fetch_add(mover[i] == ms.root_cp ? won : MCTS_SCALE - won,
+                                            std::memory_order_relaxed);
+    }
+}
+
+/* mcts_job
+ - The playout loop of every thread, as handed to the thread pool. */
+struct mcts_job
+{
+    mcts_search *ms;
+    void (*worker)(mcts_search &, int, SearchStats &);
+    SearchStats *stats;
+};
+
+static void run_mcts_job(void *arg, int t)
+{
+    mcts_job &j = *static_cast<mcts_job *>(arg);
+    j.worker(*j.ms, t, j.stats[t]);
+}
+
+/* mcts_best_move
+ - ALGO_MCTS for the root gs (hash set) and its actions acts: playouts for movetime_ms, or
+   opt.mcts_playouts of them without a budget, on opt.threads threads sharing one tree.
+ - The tree lives in the session's pool when there is a session, else in one allocated for the call.
+ - Answers the most visited root move; its mean reward r becomes the score through the inverse of
+   score_to_chance, clamped so a sampled result is never reported as a proven one. */
+static EngineResult mcts_best_move(const game_state &gs, int H, int W, char current_player,
+                                   const std::vector<item> &items, const std::vector<action> &acts, int movetime_ms,
+                                   std::chrono::steady_clock::time_point start, const EngineOptions &opt,
+                                   std::unique_ptr<mcts_tree> *session_tree)
+{
+    std::unique_ptr<mcts_tree> own;
+    std::unique_ptr<mcts_tree> &slot = session_tree ? *session_tree : own;
+    if (!slot)
+        slot.reset(new mcts_tree);
+    mcts_tree &t = *slot;
+    t.reset(std::max(opt.mcts_nodes, acts.size() + 1));
+
+    // the root is expanded up front with the same actions the minimax path searches
+    size_t first = t.claim(acts.size() + 1) + 1;
+    t.nodes[0].first_child = (unsigned)first;
+    t.nodes[0].n_children = (unsigned char)acts.size();
+    game_state root = gs;
+    int root_cp = current_player == 'A' ? 0 : 1;
+    if (board_class_of(H) == BOARD_SMALL)
+        mcts_priors<BOARD_SMALL>(root, root_cp, acts.data(), (int)acts.size(), items, &t.nodes[first]);
+    else
+        mcts_priors<BOARD_FULL>(root, root_cp, acts.data(), (int)acts.size(), items, &t.nodes[first]);
+    t.nodes[0].state.store(MCTS_EXPANDED, std::memory_order_release);
+
+    mcts_search ms;
+    ms.tree = &t;
+    ms.root = &gs;
+    ms.root_cp = root_cp;
+    ms.H = H;
+    ms.W = W;
+    ms.items = &items;
+    ms.timed = movetime_ms > 0;
+    ms.deadline = start + std::chrono::milliseconds(movetime_ms);
+    ms.cancel = opt.cancel;
+    ms.playouts_left = std::max(1, opt.mcts_playouts);
+
+    int threads = opt.threads > 0 ? opt.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<SearchStats> thread_stats(threads);
+    void (*worker)(mcts_search &, int, SearchStats &) =
+        board_class_of(H) == BOARD_SMALL ? mcts_worker<BOARD_SMALL> : mcts_worker<BOARD_FULL>;
+    mcts_job job = {&ms, worker, thread_stats.data()};
+    thread_pool().run(threads, run_mcts_job, &job);
+
+    SearchStats stats;
+    for (const SearchStats &ts : thread_stats)
+    {
+        stats.nodes += ts.nodes;
+        stats.leaf_evals += ts.leaf_evals;
+        stats.expanded += ts.expanded;
+        stats.successors += ts.successors;
+        stats.max_ply = std::max(stats.max_ply, ts.max_ply);
+    }
+    stats.depth = stats.max_ply;
+    stats.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats.nps = stats.elapsed_ms > 0 ? stats.nodes * 1000.0 / stats.elapsed_ms : 0.0;
+
+    size_t best = first;
+    for (size_t c = first; c < first + acts.size(); ++c)
+        if (t.nodes[c].visits.load() > t.nodes[best].visits.load())
+            best = c;
+    int visits = t.nodes[best].visits.load();
+    double r = visits ? (double)t.nodes[best].wins.load() / ((double)MCTS_SCALE * visits) : 0.5;
+    r = std::min(0.999, std::max(0.001, r));
+    int score = (int)std::lround(200.0 * std::log(r / (1.0 - r)));
+    return {t.nodes[best].act.move, score, score_to_chance(score), stats};
+}
+
+unsigned long long position_key(const position_request &req)
+{
+    return state_hash(req.gs, game_key(req.H, req.W, req.items)) ^ side_key(req.player);
+}
+
+bool play_move(position_request &req, const Move &m)
+{
+    action acts[MAX_SUCCESSORS];
+    int n = generate_actions(req.H, req.W, req.gs, req.player, acts);
+    for (int i = 0; i < n; ++i)
+    {
+        if (!same_move(acts[i].move, m))
+            continue;
+        int cp = (req.player == 'A') ? 0 : 1;
+        move_undo u;
+        make_move(req.gs, acts[i], req.player, req.items, u);
+        if (m.type == 'p' || req.gs.players[cp].s <= 0)
+        {
+            req.player = cp ? 'A' : 'B';
+            req.gs.players[1 - cp].s = req.gs.players[1 - cp].S;
+        }
+        return true;
+    }
+    return false;
+}
+
+/* best_move_from_request
+ - Search a parsed request; a movetime given with the request overrides opt.movetime_ms.
+ - An opening book move is taken instead when it was searched deep enough and is legal here.
+ - A request with no board (H == 0) gets the same answer as unparsable input. */
+EngineResult best_move_from_request(const position_request& req, const EngineOptions& opt)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    EngineResult nullRes = {{'p', '.', 0}, -INF, 0, SearchStats()};
+
+    int H = req.H, W = req.W, depth = req.depth;
+    if (H < 1 || H > MAX_ROWS || W < 1 || W > MAX_COLS)
+        return nullRes;
+    int movetime_ms = req.movetime_ms >= 0 ? req.movetime_ms : opt.movetime_ms;
+    char current_player = req.player;
+    const std::vector<item> &items = req.items;
+    game_state gs = req.gs;
+    gs.hash = state_hash(gs, game_key(H, W, items));
+
+    // a timed search rarely gets as deep as the book did, so it always takes the book move
+    const book_entry *booked = opt.book ? opt.book->probe(gs.hash ^ side_key(current_player)) : nullptr;
+    if (booked && (movetime_ms > 0 || booked->depth >= depth))
+    {
+        action legal[MAX_SUCCESSORS];
+        int n = generate_actions(H, W, gs, current_player, legal);
+        for (int i = 0; i < n; ++i)
+            if (same_move(legal[i].move, booked->move))
+            {
+                SearchStats stats;
+                stats.depth = booked->depth;
+                stats.book_hits = 1;
+                stats.elapsed_ms =
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                return {booked->move, booked->score, score_to_chance(booked->score), stats};
+            }
+    }
 
-    if (!gs.s.empty() && gs.s.back() == '\r')
-        gs.s.pop_back();
+    int threads = opt.threads > 0 ? opt.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<bool> stop(false);
+    std::vector<SearchStats> thread_stats(threads);
+
+    // a session keeps its contexts (frames, history) from earlier requests; only new ones start empty
+    std::vector<search_context> own_ctxs;
+    std::vector<search_context> &all_ctxs = opt.session ? opt.session->contexts : own_ctxs;
+    int warm = (int)std::min(all_ctxs.size(), (size_t)threads);
+    if ((int)all_ctxs.size() < threads)
+        all_ctxs.resize(threads);
+    TranspositionTable *tt = opt.tt ? opt.tt : opt.session ? &opt.session->tt : &default_table();
+    if (opt.session)
+        ++opt.session->requests;
+    search_context *ctxs = all_ctxs.data();
+    for (int t = 0; t < threads; ++t)
+    {
+        search_context &ctx = ctxs[t];
+        ctx.id = t;
+        ctx.H = H;
+        ctx.W = W;
+        ctx.items = &items;
+        ctx.root_player = current_player;
+        ctx.search_child = root_child_search(current_player, H);
+        ctx.maxpasses = std::min(depth, 10);
+        ctx.tt = tt;
+        ctx.stats = &thread_stats[t];
+        ctx.timed = movetime_ms > 0;
+        ctx.deadline = start + std::chrono::milliseconds(movetime_ms);
+        ctx.stop = &stop;
+        ctx.cancel = opt.cancel;
+        ctx.quiescence = opt.quiescence;
+        ctx.root_key = root_key(current_player, opt.quiescence);
+        ctx.nodes = 0;
+        ctx.stopped = false;
+        if (ctx.frames.size() < (size_t)INITIAL_PLIES)
+            ctx.frames.resize(INITIAL_PLIES);
+        if (ctx.duel_cache.empty())
+            ctx.duel_cache.resize(DUEL_CACHE_SIZE, duel_entry());
+        if (ctx.duel_misses.empty())
+            ctx.duel_misses.resize(DUEL_MISS_SIZE, 0);
+        ctx.ply = 0;
+        if (t >= warm)
+            std::fill(&ctx.history[0][0][0][0], &ctx.history[0][0][0][0] + sizeof(ctx.history) / sizeof(int), 0);
+    }
 
-    std::vector<game_state> ngs;
-    std::vector<Move> moves;
+    std::vector<action> acts(MAX_SUCCESSORS);
 
-    int nStates = next_states(H, W, gs, current_player, items, ngs, moves);
+    int nStates = generate_actions(H, W, gs, current_player, acts.data());
     if (nStates <= 0)
         return nullRes;
+    acts.resize(nStates);
+    if (opt.algorithm == ALGO_MCTS)
+        return mcts_best_move(gs, H, W, current_player, items, acts, movetime_ms, start, opt,
+                              opt.session ? &opt.session->mcts : nullptr);
+
+    // Without a budget search `depth` once; with one, deepen until time runs out,
+    // trying the best moves of the previous iteration first.
+    int max_depth = depth;
+    bool lazy_smp = threads > 1 && (opt.smp == SMP_LAZY || (opt.smp == SMP_AUTO && nStates < threads));
+    bool timed = movetime_ms > 0;
+    if (timed && max_depth <= 0)
+        max_depth = MAX_DEPTH;
+    int first_depth = timed ? std::min(1, max_depth) : depth;
+
+    std::vector<int> order(nStates);
+    for (int i = 0; i < nStates; ++i)
+        order[i] = i;
+    std::vector<int> scores(nStates, -INF), iter_scores(nStates);
+    std::vector<char> done(nStates, 0), iter_done(nStates);
+    SearchStats stats;
 
+    int prev_score = 0;
+    for (int d = first_depth; d <= max_depth; ++d)
+    {
+        // aspiration: search around the previous iteration's score and widen on a fail low/high
+        int window = ASPIRATION_WINDOW;
+        bool aspire = stats.depth > 0 && prev_score > -INF && prev_score < INF;
+        int lo = aspire ? prev_score - window : -INF;
+        int hi = aspire ? prev_score + window : INF;
+        bool completed;
+        for (;;)
+        {
+            std::fill(iter_done.begin(), iter_done.end(), 0);
+            completed = search_root(gs, acts, order, d, lo, hi, ctxs, threads, lazy_smp, iter_scores, iter_done);
+            if (!completed)
+                break;
+            int iter_best = -INF;
+            for (int i = 0; i < nStates; ++i)
+                if (iter_done[i])
+                    iter_best = std::max(iter_best, iter_scores[i]);
+            window *= 2;
+            if (iter_best <= lo && lo > -INF)
+                lo = (iter_best - window > -INF) ? iter_best - window : -INF;
+            else if (iter_best >= hi && hi < INF)
+                hi = (iter_best + window < INF) ? iter_best + window : INF;
+            else
+            {
+                prev_score = iter_best;
+                break;
+            }
+        }
+        if (!completed)
+        {
+            // nothing finished yet: fall back to whatever part of this iteration is done
+            if (stats.depth == 0)
+            {
+                scores = iter_scores;
+                done = iter_done;
+            }
+            break;
+        }
+        scores = iter_scores;
+        done = iter_done;
+        stats.depth = d;
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return scores[a] > scores[b]; });
+    }
+
+    for (int t = 0; t < threads; ++t)
+        stats.nodes += ctxs[t].nodes;
+    for (const SearchStats &ts : thread_stats)
+    {
+        stats.tt_hits += ts.tt_hits;
+        stats.tt_misses += ts.tt_misses;
+        stats.allocations += ts.allocations;
+        stats.beta_cutoffs += ts.beta_cutoffs;
+        stats.first_move_cutoffs += ts.first_move_cutoffs;
+        stats.leaf_evals += ts.leaf_evals;
+        stats.pass_limit += ts.pass_limit;
+        stats.duel_solved += ts.duel_solved;
+        stats.quiescence_nodes += ts.quiescence_nodes;
+        stats.expanded += ts.expanded;
+        stats.successors += ts.successors;
+        stats.max_ply = std::max(stats.max_ply, ts.max_ply);
+    }
+    stats.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats.nps = stats.elapsed_ms > 0 ? stats.nodes * 1000.0 / stats.elapsed_ms : 0.0;
+
+    // ties go to the earliest generated move, as in a single fixed-depth pass
     int best_index = 0;
     int best_score = -INF;
 
     for (int i = 0; i < nStates; ++i)
     {
-        int alpha = -INF, beta = INF, consecutivePasses = 0, maxpasses = std::min(depth, 10);
-        int score = minimax_search(
-            ngs[i],
-            depth,
-            current_player,
-            current_player,
-            H, W,
-            items,
-            alpha, beta,
-            consecutivePasses,
-            maxpasses
-        );
-
-        if (score > best_score)
-        {
-            best_score = score;
+        if (done[i] && scores[i] > best_score)
+        {
+            best_score = scores[i];
             best_index = i;
         }
     }
 
-    return {moves[best_index], best_score, score_to_chance(best_score)};
-}
\ No newline at end of file
+    return {acts[best_index].move, best_score, score_to_chance(best_score), stats};
+}
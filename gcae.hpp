@@ -1,6 +1,10 @@
 #ifndef GCAE_HPP
 #define GCAE_HPP
 
+#include <atomic>
+#include <cstddef>
+#include <iosfwd>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -27,27 +31,252 @@ struct Move
     short tocol; // 1-based column (or 0 for pass)
 };
 
+// Counters collected while searching one request
+struct SearchStats
+{
+    unsigned long long nodes = 0;     // minimax_search and quiescence calls, summed over threads (MCTS: playouts)
+    unsigned long long tt_hits = 0;   // probes that found an entry for the position (0 without a table)
+    unsigned long long tt_misses = 0; // probes that found nothing (0 without a table)
+    int depth = 0;                    // depth of the last fully searched iteration (MCTS: deepest tree node)
+    unsigned long long allocations = 0; // heap allocations inside the search (GCAE_COUNT_ALLOCS builds only)
+    unsigned long long beta_cutoffs = 0;       // nodes whose search stopped early on a cutoff
+    unsigned long long first_move_cutoffs = 0; // of those, cutoffs by the first move tried
+    unsigned long long leaf_evals = 0;  // static_eval calls at the leaves
+    unsigned long long pass_limit = 0;  // leaves ended by the consecutive pass limit (close_game_eval)
+    unsigned long long duel_solved = 0; // nodes answered exactly by the duel solver (no items or monsters left)
+    unsigned long long quiescence_nodes = 0; // horizon nodes resolving pending attacks (leaf_evals counts their evaluations)
+    unsigned long long book_hits = 0;   // 1 if the answer came from the opening book without a search
+    unsigned long long expanded = 0;    // nodes whose successors were generated
+    unsigned long long successors = 0;  // successors generated at those nodes
+    int max_ply = 0;                    // longest line searched, in moves from the root
+    double elapsed_ms = 0;              // wall time of the request
+    double nps = 0;                     // nodes per second over elapsed_ms
+
+    double first_move_ratio() const { return beta_cutoffs ? (double)first_move_cutoffs / beta_cutoffs : 0.0; }
+    double branching_factor() const { return expanded ? (double)successors / expanded : 0.0; }
+};
+
 struct EngineResult {
     Move move;
     int score;
     double winChance;
+    SearchStats stats;
+};
+
+// Board and entity limits (H <= 52, W < 100, at most 10 items)
+const int MAX_ROWS = 52;
+const int MAX_COLS = 99;
+const int MAX_ITEMS = 10;
+const int MAX_MONSTERS = 32;
+const int MAX_SUCCESSORS = MAX_ITEMS + MAX_MONSTERS + 3;
+
+struct cell
+{
+    unsigned char row; // row index 0..51
+    unsigned char col; // 1-based column
 };
 
+// Trivially copyable position; the encoded string only exists at the I/O boundary.
 struct game_state
 {
     player players[2];
-    std::string s; // encoded map string
+    cell pos[2];
+    unsigned char n_items, n_monsters; // slots in use (alive or not)
+    unsigned short item_alive;         // bit i set while item slot i is on the board
+    unsigned int monster_alive;        // bit i set while monster slot i is on the board
+    unsigned char item_id[MAX_ITEMS];  // index into the items table
+    cell item_pos[MAX_ITEMS];
+    cell monster_pos[MAX_MONSTERS];
+    unsigned long long occ[MAX_ROWS][2]; // per-row occupancy, bit col (1..99) set if a player/monster/item is there
+    unsigned long long hash;             // Zobrist key of players, live items/monsters and the game setup
+};
+
+// A generated move together with what applying it does to the position
+struct action
+{
+    Move move;
+    short cost;          // stamina spent (an approach that stops short spends everything)
+    signed char item;    // item slot collected, -1 if none
+    signed char monster; // monster slot killed, -1 if none
+};
+
+// What make_move changed, so unmake_move can revert it exactly
+struct move_undo
+{
+    player players[2];
+    cell from; // mover's previous cell
+    unsigned long long hash;
+};
+
+// Bound type of a transposition table score
+enum tt_bound
+{
+    TT_NONE = 0,
+    TT_EXACT = 1,
+    TT_LOWER = 2,
+    TT_UPPER = 3
+};
+
+struct tt_data
+{
+    int score; // from the point of view of the side to move
+    int depth;
+    int bound; // tt_bound
+    Move move; // best move found ('\0' type if none)
+};
+
+// Fixed-size transposition table of two-entry buckets.
+// Entries are stored as (key ^ data, data) pairs of atomics, so concurrent readers and writers
+// need no locks: a torn entry simply fails the key check.
+class TranspositionTable
+{
+public:
+    explicit TranspositionTable(size_t mb = 16);
+
+    void resize(size_t mb); // drops all entries; not safe while searches are running
+    void clear();
+    bool probe(unsigned long long key, tt_data &out) const;
+    void store(unsigned long long key, const tt_data &d);
+    size_t entries() const { return count; }
+
+private:
+    struct entry
+    {
+        std::atomic<unsigned long long> check{0};
+        std::atomic<unsigned long long> data{0};
+    };
+    std::unique_ptr<entry[]> table;
+    size_t count = 0; // power of two (or 0 when disabled)
+};
+
+// Parallel search strategy when more than one thread is used
+enum smp_mode
+{
+    SMP_ROOT = 0, // split the root moves between threads
+    SMP_LAZY = 1, // Lazy SMP: all threads search the whole tree and share the transposition table
+    SMP_AUTO = 2  // Lazy SMP when there are fewer root moves than threads, root splitting otherwise
+};
+
+enum search_algorithm
+{
+    ALGO_MINIMAX = 0, // iterative deepening alpha-beta on static_eval
+    ALGO_MCTS = 1     // Monte Carlo Tree Search: UCT with rollouts, threads share one tree
+};
+
+struct search_context;
+struct EngineOptions;
+struct position_request;
+class OpeningBook;
+struct mcts_tree;
+
+// Search state kept between requests of one game: a transposition table plus the per-thread
+// frames and history tables, so later requests start warm and do not allocate.
+// A session serves one request at a time.
+class SearchSession
+{
+public:
+    explicit SearchSession(size_t tt_mb = 16);
+    ~SearchSession();
+    SearchSession(const SearchSession &) = delete;
+    SearchSession &operator=(const SearchSession &) = delete;
+
+    TranspositionTable tt;
+    unsigned long long requests = 0; // requests served so far
+
+private:
+    friend EngineResult best_move_from_request(const position_request &req, const EngineOptions &opt);
+    std::vector<search_context> contexts;
+    std::unique_ptr<mcts_tree> mcts; // node pool of ALGO_MCTS, allocated on first use
+};
+
+// Per-request engine settings; the defaults match best_move_from_stream(in).
+struct EngineOptions
+{
+    SearchSession *session = nullptr; // reuse this session's table and buffers (its table unless tt is set)
+    TranspositionTable *tt = nullptr; // table to probe/store; nullptr uses the session's or the process-wide default (16 MB)
+    int movetime_ms = 0;              // wall-clock budget; 0 searches exactly `depth` (the input header may set it)
+    int threads = 1;                  // search threads; 0 uses every hardware thread
+    int smp = SMP_AUTO;               // how threads > 1 share the work (smp_mode)
+    bool quiescence = true;           // play out attacks at the depth horizon before evaluating
+    std::atomic<bool> *cancel = nullptr; // raised by another thread to stop the search; the answer then comes
+                                         // from the last completed iteration (stats.depth == 0 if none)
+    const OpeningBook *book = nullptr;   // probed before searching (book.hpp)
+    int algorithm = ALGO_MINIMAX;        // search_algorithm
+    size_t mcts_nodes = 1 << 18;         // ALGO_MCTS node pool; the tree stops growing once it is full
+    int mcts_playouts = 20000;           // ALGO_MCTS playouts when there is no time budget
 };
 
 // Public utilities (optional but useful for tests)
 void encode(int H, int W, const std::vector<std::vector<char>> &board, std::string &out);
 void decode(int H, int W, std::vector<std::vector<char>> &board, const std::string &in);
 
+// Convert between the encoded state string and game_state (players' stats are left untouched).
+bool decode_state(int H, int W, const std::string &in, game_state &gs);
+void encode_state(const game_state &gs, std::string &out);
+
+// One request as the engine searches it: everything the text input describes, already parsed.
+struct position_request
+{
+    int H = 0, W = 0;
+    char player = 'A';       // side to move
+    int depth = 0;
+    int movetime_ms = -1;    // budget given with the request; -1 if none (EngineOptions::movetime_ms applies)
+    std::vector<item> items; // items table
+    game_state gs;           // gs.hash is computed by the search
+};
+
+// Parse one text request (header, stats, items, encoded state); false if it is missing or malformed.
+bool read_request(std::istream &in, position_request &req);
+
 // Core API
 // Reads file_name, returns the best move, move score and win chance with the move for the current player.
+// With a time budget the search deepens 1, 2, ... up to `depth` and answers from the last completed iteration.
 EngineResult best_move_from_stream(std::istream& in);
+EngineResult best_move_from_stream(std::istream& in, const EngineOptions& opt);
+// Same search for a request that is already parsed (e.g. decoded from a binary position file).
+// With opt.book, a book move searched at least `depth` deep (any depth for a timed request) is
+// answered without searching.
+EngineResult best_move_from_request(const position_request &req, const EngineOptions &opt);
+
+// Zobrist key of the request's position and side to move; it does not depend on depth or movetime.
+// Keys are computed, not drawn at random, so they are the same in every process and build.
+unsigned long long position_key(const position_request &req);
+
+// Play m for req.player under the README turn rules: the round goes on while m is not a pass and
+// the mover has stamina left; otherwise the other player moves next, with full stamina.
+// False if m is not one of the position's moves. Whether the game is over is left to the caller.
+bool play_move(position_request &req, const Move &m);
 
 int next_states(int H, int W, const game_state &gs, char next_player, const std::vector<item> &items,
                 std::vector<game_state> &ngs, std::vector<Move> &moves);
 
+// Make/unmake interface used by the search: generate the actions of a position, then apply and
+// revert them in place on one mutable game_state instead of copying a state per child.
+// generate_actions writes at most MAX_SUCCESSORS actions to out and returns how many.
+int generate_actions(int H, int W, const game_state &gs, char current_player, action *out);
+void make_move(game_state &gs, const action &a, char current_player, const std::vector<item> &items, move_undo &u);
+void unmake_move(game_state &gs, const action &a, char current_player, const move_undo &u);
+
+// Leaf evaluation of the search from root_player's point of view (decisive once the game is over).
+int static_eval(const game_state &gs, char root_player);
+
+const int EVAL_BATCH_MAX = 48; // MAX_SUCCESSORS rounded up to whole 8-lane vectors
+
+// The stats static_eval reads, for up to EVAL_BATCH_MAX positions ([player][position]; lanes past n
+// are padding).
+struct eval_batch
+{
+    int n = 0;
+    alignas(32) int H[2][EVAL_BATCH_MAX];
+    alignas(32) int A[2][EVAL_BATCH_MAX];
+    alignas(32) int D[2][EVAL_BATCH_MAX];
+    alignas(32) int S[2][EVAL_BATCH_MAX];
+
+    void add(const game_state &gs); // append gs (n < EVAL_BATCH_MAX)
+};
+
+// out[i] = static_eval(position i, root_player) for i < b.n, e.g. for all successors of a node.
+// Uses AVX2 or SSE2 kernels where the CPU has them and a scalar loop elsewhere; same results.
+void static_eval_batch(const eval_batch &b, char root_player, int *out);
+
 #endif // GCAE_HPP
\ No newline at end of file
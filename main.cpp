@@ -1,38 +1,461 @@
 #include "gcae.hpp"
+#include "book.hpp"
+#include "posfile.hpp"
+#include "server.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
-int main()
+/* read_position
+ - Collect the lines of one END-terminated position; false once there is nothing left to solve. */
+static bool read_position(std::istream &in, std::string &text)
+{
+    text.clear();
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line == "END")
+            break;
+
+        text += line + "\n";
+    }
+    return !text.empty();
+}
+
+/* print_result
+ - Result line, followed by the stats line when requested. */
+static void print_result(std::ostream &out, const EngineResult &result, bool print_stats)
+{
+    out << result.move.type << ' '
+        << result.move.torow << ' '
+        << result.move.tocol << ' '
+        << result.score << ' '
+        << result.winChance << '\n';
+
+    if (!print_stats)
+        return;
+    const SearchStats &st = result.stats;
+    out << "stats depth=" << st.depth
+        << " max_ply=" << st.max_ply
+        << " nodes=" << st.nodes
+        << " leaf_evals=" << st.leaf_evals
+        << " pass_limit=" << st.pass_limit
+        << " duel_solved=" << st.duel_solved
+        << " qnodes=" << st.quiescence_nodes
+        << " book=" << st.book_hits
+        << " cutoffs=" << st.beta_cutoffs
+        << " first_move_rate=" << st.first_move_ratio()
+        << " branching=" << st.branching_factor();
+    if (st.tt_hits + st.tt_misses)
+        out << " tt_hits=" << st.tt_hits << " tt_misses=" << st.tt_misses;
+    out << " time_ms=" << st.elapsed_ms
+        << " nps=" << (unsigned long long)st.nps
+#ifdef GCAE_COUNT_ALLOCS
+        << " allocations=" << st.allocations
+#endif
+        << '\n';
+}
+
+/* batch_queue
+ - Positions read ahead of the workers and results waiting for their turn to be printed.
+ - At most `capacity` positions are between the reader and the output at any time: the reader
+   blocks until the oldest one is printed, so memory stays bounded however long the input is. */
+struct batch_queue
+{
+    std::mutex m;
+    std::condition_variable has_work, has_room;
+    std::deque<std::pair<unsigned long long, std::string>> pending; // read, not yet taken by a worker
+    std::vector<std::string> results;                              // printed text, slot seq % capacity
+    std::vector<char> ready;
+    unsigned long long next_out = 0; // sequence number of the next result to print
+    bool eof = false;
+};
+
+/* batch_worker
+ - Solve positions from the queue with a table of its own and print every result that is next in
+   input order. */
+static void batch_worker(batch_queue &q, EngineOptions opt, size_t tt_mb, bool print_stats)
+{
+    TranspositionTable tt(tt_mb);
+    opt.tt = &tt;
+    size_t capacity = q.results.size();
+    std::string text;
+    std::ostringstream out;
+
+    while (true)
+    {
+        unsigned long long seq;
+        {
+            std::unique_lock<std::mutex> lock(q.m);
+            q.has_work.wait(lock, [&] { return !q.pending.empty() || q.eof; });
+            if (q.pending.empty())
+                return;
+            seq = q.pending.front().first;
+            text.swap(q.pending.front().second);
+            q.pending.pop_front();
+        }
+
+        std::istringstream iss(text);
+        EngineResult result = best_move_from_stream(iss, opt);
+        out.str(std::string());
+        print_result(out, result, print_stats);
+
+        std::lock_guard<std::mutex> lock(q.m);
+        q.results[seq % capacity] = out.str();
+        q.ready[seq % capacity] = 1;
+        bool printed = false;
+        while (q.ready[q.next_out % capacity])
+        {
+            size_t slot = q.next_out % capacity;
+            std::cout << q.results[slot];
+            q.ready[slot] = 0;
+            ++q.next_out;
+            printed = true;
+        }
+        if (printed)
+        {
+            std::cout.flush();
+            q.has_room.notify_one();
+        }
+    }
+}
+
+/* run_batch
+ - Read positions from `in` on this thread while `jobs` workers solve them; results come out in input order. */
+static void run_batch(std::istream &in, int jobs, const EngineOptions &opt, size_t tt_mb, bool print_stats)
+{
+    batch_queue q;
+    size_t capacity = (size_t)jobs * 4;
+    q.results.resize(capacity);
+    q.ready.assign(capacity, 0);
+
+    std::vector<std::thread> workers;
+    for (int j = 0; j < jobs; ++j)
+        workers.emplace_back(batch_worker, std::ref(q), opt, tt_mb, print_stats);
+
+    std::string text;
+    for (unsigned long long seq = 0; read_position(in, text); ++seq)
+    {
+        std::unique_lock<std::mutex> lock(q.m);
+        q.has_room.wait(lock, [&] { return seq - q.next_out < capacity; });
+        q.pending.emplace_back(seq, std::move(text));
+        q.has_work.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(q.m);
+        q.eof = true;
+    }
+    q.has_work.notify_all();
+
+    for (std::thread &w : workers)
+        w.join();
+}
+
+/* convert_positions
+ - Write the END-terminated text positions of `in` as a binary position file, one record each
+   (an unparsable position becomes an H == 0 record, so indexes still match the input). */
+static int convert_positions(std::istream &in, const char *path)
+{
+    FILE *f = std::fopen(path, "wb");
+    if (!f)
+    {
+        std::cerr << "cannot create " << path << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    file_header h;
+    std::memcpy(h.magic, POSFILE_MAGIC, sizeof h.magic);
+    h.byte_order = FILE_BYTE_ORDER;
+    h.record_size = sizeof(position_record);
+    h.count = 0;
+    bool ok = std::fwrite(&h, sizeof h, 1, f) == 1;
+
+    std::string text;
+    position_request req;
+    position_record rec;
+    while (ok && read_position(in, text))
+    {
+        std::istringstream iss(text);
+        if (read_request(iss, req))
+            encode_record(req, rec);
+        else
+            std::memset(&rec, 0, sizeof rec);
+        ok = std::fwrite(&rec, sizeof rec, 1, f) == 1;
+        ++h.count;
+    }
+    ok = ok && std::fseek(f, 0, SEEK_SET) == 0 && std::fwrite(&h, sizeof h, 1, f) == 1;
+    if (std::fclose(f) != 0)
+        ok = false;
+    if (!ok)
+    {
+        std::cerr << "cannot write " << path << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    std::cerr << "converted " << h.count << " positions\n";
+    return 0;
+}
+
+/* position_worker
+ - Solve records of a position file, taking the next block of indexes until none are left; results
+   go straight into their slot of the result file. */
+static void position_worker(const PositionFile &positions, ResultFile &results, std::atomic<size_t> &next,
+                            EngineOptions opt, size_t tt_mb)
+{
+    const size_t BLOCK = 16;
+    TranspositionTable tt(tt_mb);
+    opt.tt = &tt;
+    position_request req;
+    for (size_t begin; (begin = next.fetch_add(BLOCK)) < positions.size();)
+    {
+        size_t end = std::min(begin + BLOCK, positions.size());
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (!decode_record(positions[i], req))
+                req.H = 0; // answered like a position the text reader rejects
+            EngineResult result = best_move_from_request(req, opt);
+            result_record &out = results[i];
+            out.move = result.move;
+            out.score = result.score;
+            out.depth = result.stats.depth;
+            out.win_chance = (float)result.winChance;
+            out.nodes = result.stats.nodes;
+            out.elapsed_ms = (float)result.stats.elapsed_ms;
+            out.reserved = 0;
+        }
+    }
+}
+
+/* run_positions
+ - Solve a binary position file with `jobs` workers (each with its own table) into a result file. */
+static int run_positions(const char *in_path, const char *out_path, int jobs, const EngineOptions &opt, size_t tt_mb)
+{
+    PositionFile positions;
+    ResultFile results;
+    std::string error;
+    if (!positions.open(in_path, error))
+    {
+        std::cerr << in_path << ": " << error << "\n";
+        return 1;
+    }
+    if (!results.create(out_path, positions.size(), error))
+    {
+        std::cerr << out_path << ": " << error << "\n";
+        return 1;
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (int j = 1; j < jobs; ++j)
+        workers.emplace_back(position_worker, std::cref(positions), std::ref(results), std::ref(next), opt, tt_mb);
+    position_worker(positions, results, next, opt, tt_mb);
+    for (std::thread &w : workers)
+        w.join();
+
+    if (!results.close(error))
+    {
+        std::cerr << out_path << ": " << error << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+/* print_results
+ - Print a result file as the text protocol's result lines. */
+static int print_results(const char *path)
+{
+    std::vector<result_record> results;
+    std::string error;
+    if (!read_results(path, results, error))
+    {
+        std::cerr << path << ": " << error << "\n";
+        return 1;
+    }
+    for (const result_record &r : results)
+        std::cout << r.move.type << ' '
+                  << r.move.torow << ' '
+                  << r.move.tocol << ' '
+                  << r.score << ' '
+                  << r.win_chance << '\n';
+    return 0;
+}
+
+/* Usage: gcae [--tt-mb N] [--movetime MS] [--threads N] [--smp root|lazy|auto] [--jobs N] [--book FILE]
+             [--engine minimax|mcts] [--playouts N] [--stats] [FILE | < positions]
+        gcae --serve PATH [--games N] [--ponder] [same search options]
+        gcae --convert OUT.bin [FILE | < positions]
+        gcae --positions IN.bin --results OUT.bin [--jobs N] [same search options]
+        gcae --print-results OUT.bin
+ - FILE             read the positions from FILE instead of stdin
+ - --tt-mb N        transposition table size in megabytes (0 disables it)
+ - --movetime MS    per-position time budget for iterative deepening (overridden by the input header)
+ - --threads N      search threads (0 = all hardware threads)
+ - --smp MODE       root: split root moves, lazy: Lazy SMP, auto: lazy when root moves < threads
+ - --jobs N         solve N positions at once (each with --threads threads and its own table),
+                    printing results in input order
+ - --engine ALGO    minimax (default): alpha-beta; mcts: Monte Carlo Tree Search under the same budget
+ - --playouts N     mcts playouts per position when there is no time budget (default 20000)
+ - --book FILE      answer from this opening book (see book.hpp, written by bookgen) where it has the position
+ - --stats          print a search statistics line after every result
+ - --serve PATH     answer requests on the Unix socket PATH instead (see server.hpp); --jobs requests at once
+ - --games N        game sessions the server keeps warm (default 16)
+ - --ponder         server: search ahead on a game while waiting for its next request
+ - --convert FILE   write the positions read from stdin as a binary position file (see posfile.hpp)
+ - --positions FILE solve a binary position file, reading it in place; needs --results
+ - --results FILE   binary result file of --positions, one record per position in the same order
+ - --print-results FILE  print a result file as result lines */
+int main(int argc, char **argv)
 {
     std::ios::sync_with_stdio(false);
     std::cin.tie(nullptr);
 
-    while (true)
+    size_t tt_mb = 16;
+    int movetime_ms = 0;
+    int threads = 1;
+    int smp = SMP_AUTO;
+    int jobs = 1;
+    bool print_stats = false;
+    const char *serve_path = nullptr;
+    int max_games = 16;
+    bool ponder = false;
+    const char *book_path = nullptr;
+    int algorithm = ALGO_MINIMAX;
+    int playouts = 20000;
+    const char *input_path = nullptr; // positions are read from this file instead of stdin
+    const char *convert_path = nullptr, *positions_path = nullptr, *results_path = nullptr, *print_path = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--tt-mb") == 0 && i + 1 < argc)
+            tt_mb = (size_t)std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--movetime") == 0 && i + 1 < argc)
+            movetime_ms = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--smp") == 0 && i + 1 < argc)
+        {
+            ++i;
+            smp = std::strcmp(argv[i], "root") == 0 ? SMP_ROOT : std::strcmp(argv[i], "lazy") == 0 ? SMP_LAZY : SMP_AUTO;
+        }
+        else if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+            jobs = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+            algorithm = std::strcmp(argv[++i], "mcts") == 0 ? ALGO_MCTS : ALGO_MINIMAX;
+        else if (std::strcmp(argv[i], "--playouts") == 0 && i + 1 < argc)
+            playouts = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--book") == 0 && i + 1 < argc)
+            book_path = argv[++i];
+        else if (std::strcmp(argv[i], "--stats") == 0)
+            print_stats = true;
+        else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            serve_path = argv[++i];
+        else if (std::strcmp(argv[i], "--games") == 0 && i + 1 < argc)
+            max_games = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--ponder") == 0)
+            ponder = true;
+        else if (std::strcmp(argv[i], "--convert") == 0 && i + 1 < argc)
+            convert_path = argv[++i];
+        else if (std::strcmp(argv[i], "--positions") == 0 && i + 1 < argc)
+            positions_path = argv[++i];
+        else if (std::strcmp(argv[i], "--results") == 0 && i + 1 < argc)
+            results_path = argv[++i];
+        else if (std::strcmp(argv[i], "--print-results") == 0 && i + 1 < argc)
+            print_path = argv[++i];
+        else if (argv[i][0] != '-' && !input_path)
+            input_path = argv[i];
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--tt-mb N] [--movetime MS] [--threads N] [--smp root|lazy|auto] [--jobs N] [--book FILE]\n"
+                      << "       " << std::string(std::strlen(argv[0]), ' ') << " [--engine minimax|mcts] [--playouts N] [--stats] [FILE | < positions]\n"
+                      << "       " << argv[0] << " --serve PATH [--games N] [--ponder] [search options]\n"
+                      << "       " << argv[0] << " --convert OUT.bin [FILE | < positions]\n"
+                      << "       " << argv[0] << " --positions IN.bin --results OUT.bin [--jobs N] [search options]\n"
+                      << "       " << argv[0] << " --print-results OUT.bin\n";
+            return 1;
+        }
+    }
+    if (positions_path && !results_path)
     {
-        std::string line;
-        std::string fullInput;
+        std::cerr << "--positions needs --results\n";
+        return 1;
+    }
 
-        while (std::getline(std::cin, line))
+    EngineOptions opt;
+    opt.movetime_ms = movetime_ms;
+    opt.threads = threads;
+    opt.smp = smp;
+    opt.algorithm = algorithm;
+    opt.mcts_playouts = playouts;
+    OpeningBook book;
+    if (book_path)
+    {
+        std::string error;
+        if (!book.open(book_path, error))
         {
-            if (line == "END")
-                break;
+            std::cerr << book_path << ": " << error << "\n";
+            return 1;
+        }
+        opt.book = &book;
+    }
 
-            fullInput += line + "\n";
+    std::ifstream input_file;
+    if (input_path)
+    {
+        input_file.open(input_path);
+        if (!input_file)
+        {
+            std::cerr << "cannot open " << input_path << "\n";
+            return 1;
         }
+    }
+    std::istream &input = input_path ? input_file : std::cin;
 
-        if (fullInput.empty())
-            break;
+    if (convert_path)
+        return convert_positions(input, convert_path);
+    if (print_path)
+        return print_results(print_path);
+    if (positions_path)
+        return run_positions(positions_path, results_path, jobs, opt, tt_mb);
+
+    if (serve_path)
+    {
+        ServerOptions sopt;
+        sopt.path = serve_path;
+        sopt.engine = opt;
+        sopt.tt_mb = tt_mb;
+        sopt.jobs = jobs;
+        sopt.max_games = max_games;
+        sopt.ponder = ponder;
+        return run_server(sopt);
+    }
+
+    if (jobs > 1)
+    {
+        run_batch(input, jobs, opt, tt_mb, print_stats);
+        return 0;
+    }
+
+    TranspositionTable tt(tt_mb);
+    opt.tt = &tt;
 
+    std::string fullInput;
+    while (read_position(input, fullInput))
+    {
         std::istringstream iss(fullInput);
 
-        EngineResult result = best_move_from_stream(iss);
+        EngineResult result = best_move_from_stream(iss, opt);
 
-        std::cout << result.move.type << ' '
-                  << result.move.torow << ' '
-                  << result.move.tocol << ' '
-                  << result.score << ' '
-                  << result.winChance << std::endl;
+        print_result(std::cout, result, print_stats);
+        std::cout.flush();
     }
 
     return 0;
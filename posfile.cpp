@@ -0,0 +1,310 @@
+#include "posfile.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+void encode_record(const position_request &req, position_record &rec)
+{
+    std::memset(&rec, 0, sizeof rec);
+    const game_state &gs = req.gs;
+    rec.H = (uint8_t)req.H;
+    rec.W = (uint8_t)req.W;
+    rec.side = req.player;
+    rec.n_items = (uint8_t)req.items.size();
+    rec.depth = req.depth;
+    rec.movetime_ms = req.movetime_ms;
+    rec.players[0] = gs.players[0];
+    rec.players[1] = gs.players[1];
+    for (size_t i = 0; i < req.items.size(); ++i)
+        rec.items[i] = req.items[i];
+
+    // only what is on the board; a freshly parsed state has every slot alive, but keep the mask honest
+    rec.pos[0] = gs.pos[0];
+    rec.pos[1] = gs.pos[1];
+    for (int k = 0; k < gs.n_items; ++k)
+        if (gs.item_alive & (1u << k))
+        {
+            rec.object_id[rec.n_objects] = gs.item_id[k];
+            rec.object_pos[rec.n_objects++] = gs.item_pos[k];
+        }
+    for (int k = 0; k < gs.n_monsters; ++k)
+        if (gs.monster_alive & (1u << k))
+            rec.monster_pos[rec.n_monsters++] = gs.monster_pos[k];
+}
+
+static inline bool on_board(const position_record &rec, cell c)
+{
+    return c.row < rec.H && c.col >= 1 && c.col <= rec.W;
+}
+
+static inline void mark(game_state &gs, cell c)
+{
+    gs.occ[c.row][c.col >> 6] |= 1ULL << (c.col & 63);
+}
+
+bool decode_record(const position_record &rec, position_request &req)
+{
+    if (rec.H < 1 || rec.H > MAX_ROWS || rec.W < 1 || rec.W > MAX_COLS || (rec.side != 'A' && rec.side != 'B') ||
+        rec.n_items > MAX_ITEMS || rec.n_objects > MAX_ITEMS || rec.n_monsters > MAX_MONSTERS)
+        return false;
+    if (!on_board(rec, rec.pos[0]) || !on_board(rec, rec.pos[1]))
+        return false;
+
+    req.H = rec.H;
+    req.W = rec.W;
+    req.player = rec.side;
+    req.depth = rec.depth;
+    req.movetime_ms = rec.movetime_ms;
+    req.items.assign(rec.items, rec.items + rec.n_items);
+
+    game_state &gs = req.gs;
+    gs.players[0] = rec.players[0];
+    gs.players[1] = rec.players[1];
+    gs.pos[0] = rec.pos[0];
+    gs.pos[1] = rec.pos[1];
+    gs.n_items = rec.n_objects;
+    gs.n_monsters = rec.n_monsters;
+    gs.item_alive = (unsigned short)((1u << rec.n_objects) - 1);
+    gs.monster_alive = rec.n_monsters == 32 ? ~0u : (1u << rec.n_monsters) - 1;
+    std::memcpy(gs.item_id, rec.object_id, sizeof gs.item_id);
+    std::memcpy(gs.item_pos, rec.object_pos, sizeof gs.item_pos);
+    std::memcpy(gs.monster_pos, rec.monster_pos, sizeof gs.monster_pos);
+    gs.hash = 0;
+    std::memset(gs.occ, 0, sizeof gs.occ);
+
+    mark(gs, gs.pos[0]);
+    mark(gs, gs.pos[1]);
+    for (int k = 0; k < rec.n_objects; ++k)
+    {
+        if (rec.object_id[k] >= rec.n_items || !on_board(rec, rec.object_pos[k]))
+            return false;
+        mark(gs, rec.object_pos[k]);
+    }
+    for (int k = 0; k < rec.n_monsters; ++k)
+    {
+        if (!on_board(rec, rec.monster_pos[k]))
+            return false;
+        mark(gs, rec.monster_pos[k]);
+    }
+    return true;
+}
+
+/* check_header
+ - Validate a file header against the expected magic and record size; count is checked by the caller. */
+bool check_header(const file_header &h, const char *magic, size_t record_size, std::string &error)
+{
+    if (std::memcmp(h.magic, magic, sizeof h.magic) != 0)
+        error = "not a gcae file of this kind";
+    else if (h.byte_order != FILE_BYTE_ORDER || h.record_size != record_size)
+        error = "written with another byte order or record layout";
+    else
+        return true;
+    return false;
+}
+
+#ifndef _WIN32
+
+PositionFile::~PositionFile()
+{
+    if (base)
+        munmap(base, bytes);
+}
+
+bool PositionFile::open(const std::string &path, std::string &error)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) < 0)
+    {
+        error = std::strerror(errno);
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    bytes = (size_t)sb.st_size;
+    if (bytes < sizeof(file_header))
+    {
+        ::close(fd);
+        error = "truncated header";
+        return false;
+    }
+    base = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        base = nullptr;
+        error = std::strerror(errno);
+        return false;
+    }
+    madvise(base, bytes, MADV_SEQUENTIAL);
+
+    const file_header &h = *(const file_header *)base;
+    if (!check_header(h, POSFILE_MAGIC, sizeof(position_record), error))
+        return false;
+    if (h.count > (bytes - sizeof h) / sizeof(position_record))
+    {
+        error = "truncated records";
+        return false;
+    }
+    records = (const position_record *)((const char *)base + sizeof h);
+    count = (size_t)h.count;
+    return true;
+}
+
+ResultFile::~ResultFile()
+{
+    if (base)
+        munmap(base, bytes);
+}
+
+bool ResultFile::create(const std::string &p, size_t count, std::string &error)
+{
+    path = p;
+    bytes = sizeof(file_header) + count * sizeof(result_record);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)bytes) < 0)
+    {
+        error = std::strerror(errno);
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        base = nullptr;
+        error = std::strerror(errno);
+        return false;
+    }
+    // the magic goes in last, so a run that dies halfway never leaves a file that looks complete
+    file_header &h = *(file_header *)base;
+    h.byte_order = FILE_BYTE_ORDER;
+    h.record_size = sizeof(result_record);
+    h.count = count;
+    records = (result_record *)((char *)base + sizeof h);
+    return true;
+}
+
+bool ResultFile::close(std::string &error)
+{
+    if (!base)
+        return true;
+    std::memcpy(((file_header *)base)->magic, RESFILE_MAGIC, sizeof RESFILE_MAGIC);
+    bool ok = msync(base, bytes, MS_SYNC) == 0;
+    if (!ok)
+        error = std::strerror(errno);
+    munmap(base, bytes);
+    base = nullptr;
+    return ok;
+}
+
+#else
+
+// No mmap: read the whole file into memory and write the results out on close().
+
+PositionFile::~PositionFile()
+{
+    delete[] (char *)base;
+}
+
+bool PositionFile::open(const std::string &path, std::string &error)
+{
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        error = std::strerror(errno);
+        return false;
+    }
+    file_header h;
+    if (std::fread(&h, sizeof h, 1, f) != 1)
+    {
+        std::fclose(f);
+        error = "truncated header";
+        return false;
+    }
+    if (!check_header(h, POSFILE_MAGIC, sizeof(position_record), error))
+    {
+        std::fclose(f);
+        return false;
+    }
+    bytes = (size_t)h.count * sizeof(position_record);
+    base = new char[bytes ? bytes : 1];
+    bool ok = std::fread(base, 1, bytes, f) == bytes;
+    std::fclose(f);
+    if (!ok)
+    {
+        error = "truncated records";
+        return false;
+    }
+    records = (const position_record *)base;
+    count = (size_t)h.count;
+    return true;
+}
+
+ResultFile::~ResultFile()
+{
+    delete[] (char *)base;
+}
+
+bool ResultFile::create(const std::string &p, size_t count, std::string &error)
+{
+    path = p;
+    bytes = sizeof(file_header) + count * sizeof(result_record);
+    base = new char[bytes]();
+    file_header &h = *(file_header *)base;
+    h.byte_order = FILE_BYTE_ORDER;
+    h.record_size = sizeof(result_record);
+    h.count = count;
+    records = (result_record *)((char *)base + sizeof h);
+    return true;
+}
+
+bool ResultFile::close(std::string &error)
+{
+    if (!base)
+        return true;
+    std::memcpy(((file_header *)base)->magic, RESFILE_MAGIC, sizeof RESFILE_MAGIC);
+    FILE *f = std::fopen(path.c_str(), "wb");
+    bool ok = f && std::fwrite(base, 1, bytes, f) == bytes;
+    if (f && std::fclose(f) != 0)
+        ok = false;
+    if (!ok)
+        error = std::strerror(errno);
+    delete[] (char *)base;
+    base = nullptr;
+    return ok;
+}
+
+#endif
+
+bool read_results(const std::string &path, std::vector<result_record> &out, std::string &error)
+{
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        error = std::strerror(errno);
+        return false;
+    }
+    file_header h;
+    bool ok = std::fread(&h, sizeof h, 1, f) == 1;
+    if (!ok)
+        error = "truncated header";
+    else if ((ok = check_header(h, RESFILE_MAGIC, sizeof(result_record), error)))
+    {
+        out.resize((size_t)h.count);
+        ok = std::fread(out.data(), sizeof(result_record), out.size(), f) == out.size();
+        if (!ok)
+            error = "truncated records";
+    }
+    std::fclose(f);
+    return ok;
+}
@@ -0,0 +1,114 @@
+#ifndef GCAE_POSFILE_HPP
+#define GCAE_POSFILE_HPP
+
+#include "gcae.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary position and result files for bulk runs (gcae --convert / --positions).
+//
+// A file is a 24-byte header followed by `count` fixed-size records. Records hold the engine's own
+// structs in native byte order and every field is naturally aligned, so a mapped file is read in
+// place: decoding a record is a handful of copies instead of parsing text. The header's byte-order
+// mark and record size reject files written by a build with another layout.
+
+const char POSFILE_MAGIC[8] = {'G', 'C', 'A', 'E', 'P', 'O', 'S', '1'};
+const char RESFILE_MAGIC[8] = {'G', 'C', 'A', 'E', 'R', 'E', 'S', '1'};
+const uint32_t FILE_BYTE_ORDER = 0x01020304;
+
+struct file_header
+{
+    char magic[8];
+    uint32_t byte_order;  // FILE_BYTE_ORDER as written by the producer
+    uint32_t record_size; // sizeof the record type
+    uint64_t count;       // records following the header
+};
+
+// One request; H == 0 marks a position the converter could not parse (it is answered like one).
+struct position_record
+{
+    uint8_t H, W;
+    char side;                       // side to move, 'A' or 'B'
+    uint8_t n_items;                 // entries of the items table
+    int32_t depth;
+    int32_t movetime_ms;             // -1 if the request gave none
+    player players[2];               // stats of A and B
+    item items[MAX_ITEMS];           // items table
+    uint8_t n_objects, n_monsters;   // item cells and monsters on the board
+    cell pos[2];                     // A and B
+    uint8_t object_id[MAX_ITEMS];    // items table index of each item cell
+    cell object_pos[MAX_ITEMS];
+    cell monster_pos[MAX_MONSTERS];
+};
+
+// One answer, at the same index as its position.
+struct result_record
+{
+    Move move;
+    int32_t score;
+    int32_t depth;      // last completed iteration
+    float win_chance;
+    uint64_t nodes;
+    float elapsed_ms;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(file_header) == 24, "file_header layout");
+static_assert(sizeof(position_record) == 212, "position_record layout");
+static_assert(sizeof(result_record) == 32, "result_record layout");
+
+// Validate a header against the expected magic and record size (also used by the opening book).
+bool check_header(const file_header &h, const char *magic, size_t record_size, std::string &error);
+
+// Record <-> parsed request. decode_record validates everything an index depends on, so a corrupt
+// file yields false rather than a bad game_state.
+void encode_record(const position_request &req, position_record &rec);
+bool decode_record(const position_record &rec, position_request &req);
+
+// Read-only view of a position file (memory-mapped where the platform allows it).
+class PositionFile
+{
+public:
+    PositionFile() = default;
+    ~PositionFile();
+    PositionFile(const PositionFile &) = delete;
+    PositionFile &operator=(const PositionFile &) = delete;
+
+    bool open(const std::string &path, std::string &error);
+    size_t size() const { return count; }
+    const position_record &operator[](size_t i) const { return records[i]; }
+
+private:
+    void *base = nullptr;
+    size_t bytes = 0;
+    const position_record *records = nullptr;
+    size_t count = 0;
+};
+
+// Result file of a fixed number of records, written in place in any order; close() publishes it.
+class ResultFile
+{
+public:
+    ResultFile() = default;
+    ~ResultFile();
+    ResultFile(const ResultFile &) = delete;
+    ResultFile &operator=(const ResultFile &) = delete;
+
+    bool create(const std::string &path, size_t count, std::string &error);
+    result_record &operator[](size_t i) { return records[i]; }
+    bool close(std::string &error);
+
+private:
+    std::string path;
+    void *base = nullptr;
+    size_t bytes = 0;
+    result_record *records = nullptr;
+};
+
+// Read a whole result file (for printing or comparing); false with error set if it is not one.
+bool read_results(const std::string &path, std::vector<result_record> &out, std::string &error);
+
+#endif // GCAE_POSFILE_HPP
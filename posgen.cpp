@@ -0,0 +1,55 @@
+#include "posgen.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+static std::string cell_name(int row, int col)
+{
+    std::string s(1, row < 26 ? char('A' + row) : char('a' + row - 26));
+    return s + std::to_string(col);
+}
+
+/* generate_position
+ - A rows x cols board with both players, `monsters` monsters and `items` items on distinct random
+   cells; player stats and item modifiers are drawn from the configured ranges. */
+std::string generate_position(const gen_options &g, gen_rng &rng)
+{
+    int cells = g.rows * g.cols;
+    int entities = std::min(2 + g.monsters + g.items, cells);
+    std::ostringstream t;
+    t << g.rows << ' ' << g.cols << ' ' << (rng.next() & 1 ? 'B' : 'A') << ' ' << g.depth << '\n';
+    for (int p = 0; p < 2; ++p)
+    {
+        int S = rng.range(g.stamina);
+        t << rng.range(g.hp) << ' ' << rng.range(g.atk) << ' ' << rng.range(g.def) << ' ' << S << ' ' << S << '\n';
+    }
+    t << g.items << '\n';
+    for (int i = 0; i < g.items; ++i)
+        t << rng.range(-10, 30) << ' ' << rng.range(-5, 15) << ' ' << rng.range(-5, 15) << ' ' << rng.range(-3, 8)
+          << '\n';
+
+    // partial Fisher-Yates over the cells picks distinct squares
+    std::vector<int> perm(cells);
+    for (int c = 0; c < cells; ++c)
+        perm[c] = c;
+    for (int e = 0; e < entities; ++e)
+        std::swap(perm[e], perm[e + (int)(rng.next() % (unsigned long long)(cells - e))]);
+
+    std::string state;
+    for (int e = 0; e < entities; ++e)
+    {
+        std::string tag = e == 0 ? "A" : e == 1 ? "B" : e < 2 + g.monsters ? "m" : "o" + std::to_string(e - 2 - g.monsters);
+        state += tag + ' ' + cell_name(perm[e] / g.cols, perm[e] % g.cols + 1) + ' ';
+    }
+    state.pop_back();
+    t << state << '\n';
+    return t.str();
+}
+
+bool parse_range(const char *s, stat_range &r)
+{
+    return std::sscanf(s, "%d:%d", &r.lo, &r.hi) == 2 && r.lo <= r.hi;
+}
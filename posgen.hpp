@@ -0,0 +1,48 @@
+#ifndef GCAE_POSGEN_HPP
+#define GCAE_POSGEN_HPP
+
+#include <string>
+
+// Seeded random positions for the tools (bench, selfplay). Positions depend only on the options and
+// the seed, so the same options give the same positions on every build and platform.
+
+struct stat_range
+{
+    int lo, hi;
+};
+
+// Options of the seeded position generator
+struct gen_options
+{
+    unsigned long long seed = 1;
+    int count = 16;
+    int rows = 16, cols = 24;
+    int monsters = 8, items = 4;
+    stat_range hp = {50, 150}, atk = {10, 50}, def = {0, 20}, stamina = {10, 30};
+    int depth = 4;
+};
+
+/* gen_rng
+ - splitmix64; unlike the <random> distributions its output is the same with every standard library. */
+struct gen_rng
+{
+    unsigned long long s;
+
+    unsigned long long next()
+    {
+        unsigned long long z = (s += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    int range(int lo, int hi) { return lo + (int)(next() % (unsigned long long)(hi - lo + 1)); }
+    int range(stat_range r) { return range(r.lo, r.hi); }
+};
+
+// Next position of rng in the text input format (players start with full stamina).
+std::string generate_position(const gen_options &g, gen_rng &rng);
+
+// Parse "LO:HI" into r; false if malformed or LO > HI.
+bool parse_range(const char *s, stat_range &r);
+
+#endif // GCAE_POSGEN_HPP
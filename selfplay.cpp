@@ -0,0 +1,363 @@
+#include "gcae.hpp"
+#include "posgen.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Usage: selfplay [--games N] [--jobs N] [--seed S] [--max-rounds R] [--log]
+                   [--engine1 SPEC] [--engine2 SPEC]
+                   [--rows R] [--cols C] [--monsters M] [--items I]
+                   [--hp LO:HI] [--atk LO:HI] [--def LO:HI] [--stamina LO:HI]
+ - SPEC is a comma-separated list of depth=D, movetime=MS, tt=MB, threads=N, quiescence=0|1,
+   engine=minimax|mcts, playouts=N (default depth=3,tt=16,quiescence=1,engine=minimax; an untimed
+   mcts engine runs playouts=N, default 20000).
+ - Plays full games between two engine configurations. Start position k comes from the seeded
+   generator (see posgen.hpp) and is played twice, engine 1 moving first as A and then as B, so
+   neither engine profits from a lucky position or from moving first.
+ - Every move is asked from best_move_from_stream and applied through next_states, with the README
+   rules between calls: A starts; a round lasts until the player passes or has no stamina left, and
+   the next player starts their round with full stamina (s = S); a player at H <= 0 loses; after 10
+   rounds in a row without an attack the stat sum (H + A + D + S) of A minus that of B decides, A
+   winning only if it is positive. A move the engine answers that next_states does not list loses the
+   game. Games still running after --max-rounds rounds are decided by the same stat sum.
+ - Without movetime the games are deterministic: each game starts from empty tables, so the results
+   do not depend on --jobs or on which worker plays which game. */
+
+// One side of the match
+struct engine_config
+{
+    int depth = 3;
+    int movetime_ms = 0;
+    size_t tt_mb = 16;
+    int threads = 1;
+    bool quiescence = true;
+    int algorithm = ALGO_MINIMAX;
+    int playouts = 20000;
+};
+
+enum game_end
+{
+    END_HP = 0,       // a player reached H <= 0
+    END_QUIET = 1,    // 10 rounds without an attack
+    END_ROUNDS = 2,   // --max-rounds reached
+    END_ILLEGAL = 3,  // an engine answered a move next_states does not list
+    END_NO_BOARD = 4  // the start position could not be parsed
+};
+
+static const char *const END_NAMES[] = {"hp", "quiet", "rounds", "illegal", "no_board"};
+
+struct game_record
+{
+    int winner_engine = 0; // 0 = engine 1, 1 = engine 2
+    int end = END_HP;
+    int rounds = 0;
+    unsigned long long moves[2] = {0, 0}; // per engine
+    unsigned long long nodes[2] = {0, 0};
+    double time_ms[2] = {0, 0};
+};
+
+static bool parse_engine(const char *spec, engine_config &e)
+{
+    std::string s(spec);
+    std::istringstream in(s);
+    std::string field;
+    while (std::getline(in, field, ','))
+    {
+        size_t eq = field.find('=');
+        if (eq == std::string::npos)
+            return false;
+        std::string key = field.substr(0, eq);
+        const char *val = field.c_str() + eq + 1;
+        long v = std::strtol(val, nullptr, 10);
+        if (key == "engine")
+        {
+            if (std::strcmp(val, "minimax") == 0)
+                e.algorithm = ALGO_MINIMAX;
+            else if (std::strcmp(val, "mcts") == 0)
+                e.algorithm = ALGO_MCTS;
+            else
+                return false;
+        }
+        else if (key == "playouts")
+            e.playouts = (int)std::max(1L, v);
+        else if (key == "depth")
+            e.depth = (int)std::max(0L, v);
+        else if (key == "movetime")
+            e.movetime_ms = (int)std::max(0L, v);
+        else if (key == "tt")
+            e.tt_mb = (size_t)std::max(0L, v);
+        else if (key == "threads")
+            e.threads = (int)std::max(0L, v);
+        else if (key == "quiescence")
+            e.quiescence = v != 0;
+        else
+            return false;
+    }
+    return e.depth > 0 || e.movetime_ms > 0;
+}
+
+/* stat_sum
+ - H + A + D + S, the stat total of the 10-round tiebreak. */
+static int stat_sum(const player &p)
+{
+    return p.H + p.A + p.D + p.S;
+}
+
+/* request_text
+ - The position as best_move_from_stream reads it, with the mover's search settings in the header. */
+static void request_text(const position_request &g, char side, const engine_config &e, std::string &out)
+{
+    std::ostringstream t;
+    t << g.H << ' ' << g.W << ' ' << side << ' ' << e.depth;
+    if (e.movetime_ms > 0)
+        t << ' ' << e.movetime_ms;
+    t << '\n';
+    for (const player &p : g.gs.players)
+        t << p.H << ' ' << p.A << ' ' << p.D << ' ' << p.s << ' ' << p.S << '\n';
+    t << g.items.size() << '\n';
+    for (const item &it : g.items)
+        t << it.dH << ' ' << it.dA << ' ' << it.dD << ' ' << it.dS << '\n';
+    std::string encoded;
+    encode_state(g.gs, encoded);
+    t << encoded << '\n';
+    out = t.str();
+}
+
+/* play_game
+ - Play one game from `start`; engine `first` (0 or 1) plays A. Tables are cleared first. */
+static game_record play_game(const std::string &start, int first, const engine_config *cfg, TranspositionTable *tt,
+                             int max_rounds)
+{
+    game_record rec;
+    position_request g;
+    std::istringstream sin(start);
+    if (!read_request(sin, g))
+    {
+        rec.end = END_NO_BOARD;
+        return rec;
+    }
+
+    EngineOptions opt[2];
+    for (int e = 0; e < 2; ++e)
+    {
+        tt[e].clear();
+        opt[e].tt = &tt[e];
+        opt[e].threads = cfg[e].threads;
+        opt[e].quiescence = cfg[e].quiescence;
+        opt[e].algorithm = cfg[e].algorithm;
+        opt[e].mcts_playouts = cfg[e].playouts;
+    }
+
+    std::vector<game_state> ngs;
+    std::vector<Move> moves;
+    std::string text;
+    int side = 0; // index of the player to move; A starts
+    int quiet = 0;
+    bool attacked = false;
+    g.gs.players[0].s = g.gs.players[0].S;
+    while (true)
+    {
+        int engine = side == 0 ? first : 1 - first;
+        char side_name = side == 0 ? 'A' : 'B';
+        request_text(g, side_name, cfg[engine], text);
+        std::istringstream in(text);
+        EngineResult r = best_move_from_stream(in, opt[engine]);
+        ++rec.moves[engine];
+        rec.nodes[engine] += r.stats.nodes;
+        rec.time_ms[engine] += r.stats.elapsed_ms;
+
+        int n = next_states(g.H, g.W, g.gs, side_name, g.items, ngs, moves);
+        int k = 0;
+        while (k < n && !(moves[k].type == r.move.type && moves[k].torow == r.move.torow &&
+                          moves[k].tocol == r.move.tocol))
+            ++k;
+        if (k == n)
+        {
+            rec.end = END_ILLEGAL;
+            rec.winner_engine = 1 - engine;
+            return rec;
+        }
+        g.gs = ngs[k];
+        attacked = attacked || r.move.type == 'a';
+
+        // an item can take the mover's own H to 0 as well
+        const player &me = g.gs.players[side], &opp = g.gs.players[1 - side];
+        if (opp.H <= 0 || me.H <= 0)
+        {
+            rec.end = END_HP;
+            rec.winner_engine = opp.H <= 0 ? engine : 1 - engine;
+            return rec;
+        }
+        if (r.move.type != 'p' && me.s > 0)
+            continue;
+
+        // the round is over: the other player starts theirs with full stamina
+        ++rec.rounds;
+        quiet = attacked ? 0 : quiet + 1;
+        attacked = false;
+        if (quiet >= 10 || rec.rounds >= max_rounds)
+        {
+            rec.end = quiet >= 10 ? END_QUIET : END_ROUNDS;
+            bool a_wins = stat_sum(g.gs.players[0]) - stat_sum(g.gs.players[1]) > 0;
+            rec.winner_engine = a_wins ? first : 1 - first;
+            return rec;
+        }
+        side = 1 - side;
+        g.gs.players[side].s = g.gs.players[side].S;
+    }
+}
+
+struct match_state
+{
+    std::vector<std::string> starts;
+    std::vector<game_record> games; // game i plays starts[i / 2], engine 1 as A when i is even
+    std::atomic<size_t> next{0};
+    std::mutex log_m;
+    bool log = false;
+};
+
+static void match_worker(match_state &m, const engine_config *cfg, int max_rounds)
+{
+    TranspositionTable tt[2] = {TranspositionTable(cfg[0].tt_mb), TranspositionTable(cfg[1].tt_mb)};
+    for (size_t i; (i = m.next.fetch_add(1)) < m.games.size();)
+    {
+        game_record &r = m.games[i] = play_game(m.starts[i / 2], (int)(i % 2), cfg, tt, max_rounds);
+        if (!m.log)
+            continue;
+        std::lock_guard<std::mutex> lock(m.log_m);
+        std::cout << "game " << i << " start=" << i / 2 << " A=engine" << (i % 2 + 1)
+                  << " winner=engine" << (r.winner_engine + 1) << " end=" << END_NAMES[r.end]
+                  << " rounds=" << r.rounds << '\n';
+    }
+}
+
+/* elo
+ - Elo difference that makes `score` (0..1) the expected score; clamped to +/-999 at the ends. */
+static double elo(double score)
+{
+    if (score <= 0)
+        return -999;
+    if (score >= 1)
+        return 999;
+    return 400.0 * std::log10(score / (1.0 - score));
+}
+
+int main(int argc, char **argv)
+{
+    gen_options g;
+    g.count = 100; // games: rounded up to an even number, two per start position
+    engine_config cfg[2];
+    int jobs = (int)std::max(1u, std::thread::hardware_concurrency());
+    int max_rounds = 200;
+    bool log = false;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i)
+    {
+        const char *a = argv[i];
+        if (std::strcmp(a, "--log") == 0)
+        {
+            log = true;
+            continue;
+        }
+        const char *v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!v)
+            ok = false;
+        else if (std::strcmp(a, "--games") == 0)
+            g.count = std::max(1, std::atoi(v));
+        else if (std::strcmp(a, "--jobs") == 0)
+            jobs = std::max(1, std::atoi(v));
+        else if (std::strcmp(a, "--seed") == 0)
+            g.seed = std::strtoull(v, nullptr, 10);
+        else if (std::strcmp(a, "--max-rounds") == 0)
+            max_rounds = std::max(1, std::atoi(v));
+        else if (std::strcmp(a, "--engine1") == 0)
+            ok = parse_engine(v, cfg[0]);
+        else if (std::strcmp(a, "--engine2") == 0)
+            ok = parse_engine(v, cfg[1]);
+        else if (std::strcmp(a, "--rows") == 0)
+            g.rows = std::min(MAX_ROWS, std::max(1, std::atoi(v)));
+        else if (std::strcmp(a, "--cols") == 0)
+            g.cols = std::min(MAX_COLS, std::max(1, std::atoi(v)));
+        else if (std::strcmp(a, "--monsters") == 0)
+            g.monsters = std::min(MAX_MONSTERS, std::max(0, std::atoi(v)));
+        else if (std::strcmp(a, "--items") == 0)
+            g.items = std::min(MAX_ITEMS, std::max(0, std::atoi(v)));
+        else if (std::strcmp(a, "--hp") == 0)
+            ok = parse_range(v, g.hp);
+        else if (std::strcmp(a, "--atk") == 0)
+            ok = parse_range(v, g.atk);
+        else if (std::strcmp(a, "--def") == 0)
+            ok = parse_range(v, g.def);
+        else if (std::strcmp(a, "--stamina") == 0)
+            ok = parse_range(v, g.stamina);
+        else
+            ok = false;
+        ++i;
+    }
+    if (!ok)
+    {
+        std::cerr << "usage: " << argv[0] << " [--games N] [--jobs N] [--seed S] [--max-rounds R] [--log]\n"
+                  << "       [--engine1 depth=D,movetime=MS,tt=MB,threads=N,quiescence=0|1,\n"
+                  << "                   engine=minimax|mcts,playouts=N] [--engine2 ...]\n"
+                  << "       [--rows R] [--cols C] [--monsters M] [--items I]\n"
+                  << "       [--hp LO:HI] [--atk LO:HI] [--def LO:HI] [--stamina LO:HI]\n";
+        return 1;
+    }
+
+    match_state m;
+    m.log = log;
+    gen_rng rng = {g.seed};
+    for (int k = 0; k < (g.count + 1) / 2; ++k)
+        m.starts.push_back(generate_position(g, rng));
+    m.games.resize(m.starts.size() * 2);
+
+    std::vector<std::thread> workers;
+    for (int j = 1; j < jobs; ++j)
+        workers.emplace_back(match_worker, std::ref(m), cfg, max_rounds);
+    match_worker(m, cfg, max_rounds);
+    for (std::thread &w : workers)
+        w.join();
+
+    // engine 1's score per game is 1 or 0 (there are no draws); the error bar is the 95% interval of
+    // the mean score, mapped through the Elo curve
+    size_t n = 0;
+    unsigned long long wins = 0, ends[5] = {0, 0, 0, 0, 0}, moves[2] = {0, 0}, nodes[2] = {0, 0}, rounds = 0;
+    double time_ms[2] = {0, 0};
+    for (const game_record &r : m.games)
+    {
+        ++ends[r.end];
+        if (r.end == END_NO_BOARD)
+            continue;
+        ++n;
+        wins += r.winner_engine == 0;
+        rounds += r.rounds;
+        for (int e = 0; e < 2; ++e)
+        {
+            moves[e] += r.moves[e];
+            nodes[e] += r.nodes[e];
+            time_ms[e] += r.time_ms[e];
+        }
+    }
+    double score = n ? (double)wins / n : 0.5;
+    double margin = n ? 1.96 * std::sqrt(score * (1 - score) / n) : 0.5;
+    double lo = elo(score - margin), hi = elo(score + margin);
+
+    std::printf("games=%zu engine1_wins=%llu engine2_wins=%llu win_rate=%.4f\n", n, wins, n - wins, score);
+    std::printf("elo_diff=%+.1f error_95=%.1f (%+.1f..%+.1f)\n", elo(score), (hi - lo) / 2, lo, hi);
+    std::printf("ends hp=%llu quiet=%llu rounds=%llu illegal=%llu no_board=%llu avg_rounds=%.1f\n", ends[END_HP],
+                ends[END_QUIET], ends[END_ROUNDS], ends[END_ILLEGAL], ends[END_NO_BOARD], n ? (double)rounds / n : 0.0);
+    for (int e = 0; e < 2; ++e)
+        std::printf("engine%d engine=%s depth=%d movetime=%d moves=%llu time_ms_per_move=%.3f nodes_per_move=%.1f\n",
+                    e + 1, cfg[e].algorithm == ALGO_MCTS ? "mcts" : "minimax", cfg[e].depth, cfg[e].movetime_ms, moves[e], moves[e] ? time_ms[e] / moves[e] : 0.0,
+                    moves[e] ? (double)nodes[e] / moves[e] : 0.0);
+    return 0;
+}
@@ -0,0 +1,540 @@
+#include "server.hpp"
+
+#include <iostream>
+
+#ifdef _WIN32
+
+int run_server(const ServerOptions &)
+{
+    std::cerr << "--serve needs Unix domain sockets, which this build does not support\n";
+    return 1;
+}
+
+#else
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Pondering (ServerOptions::ponder)
+const int PONDER_CACHE = 4;          // pondered positions remembered per game
+const int PONDER_TIME_FACTOR = 4;    // a position with a time budget is pondered for this many budgets
+const int PONDER_OPPONENT_MOVES = 16; // longest opponent round predicted before giving up
+
+/* ponder_entry
+ - A position searched before it was asked for. Only fixed-depth answers are ready to be sent: a
+   request with a time budget is searched again and finds the pondered iterations in the table. */
+struct ponder_entry
+{
+    std::string key; // request_key of the predicted request
+    bool ready;      // result is what the request would get
+    EngineResult result;
+};
+
+/* game_session
+ - Engine state of one game; its requests are searched one at a time. */
+struct game_session
+{
+    explicit game_session(size_t tt_mb) : search(tt_mb) {}
+
+    std::mutex m;
+    SearchSession search;
+    std::deque<ponder_entry> pondered; // most recent first, PONDER_CACHE at most
+};
+
+/* server_job
+ - One position waiting for a worker; the connection that sent it waits on `reply`. */
+struct server_job
+{
+    std::string game; // empty: no game id, searched with the worker's own session
+    int algorithm;    // search_algorithm: the server's --engine unless an `engine` line chose another
+    std::string text; // position without the END line
+    std::chrono::steady_clock::time_point received;
+    std::promise<std::string> reply;
+};
+
+/* server_state
+ - Everything shared by the accept loop, the connections and the workers; guarded by m. */
+struct server_state
+{
+    const ServerOptions *opt;
+    std::mutex m;
+    std::condition_variable has_work, connections_done;
+    std::deque<std::unique_ptr<server_job>> queue;
+    bool stopping = false;
+
+    std::list<std::pair<std::string, std::shared_ptr<game_session>>> games; // most recently used first
+    std::vector<int> connections;                                          // open client sockets
+    std::vector<std::atomic<bool> *> pondering; // cancel flags of the workers pondering now; raised by any request
+
+    // status counters
+    unsigned long long requests = 0, warm_requests = 0;
+    int active = 0;
+    double latency_last_ms = 0, latency_sum_ms = 0, latency_max_ms = 0;
+    unsigned long long warm_hits = 0, warm_misses = 0, cold_hits = 0, cold_misses = 0;
+    unsigned long long ponder_searches = 0, ponder_hits = 0, ponder_answers = 0;
+};
+
+static bool send_all(int fd, const std::string &s)
+{
+    size_t off = 0;
+    while (off < s.size())
+    {
+        ssize_t n = send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        off += (size_t)n;
+    }
+    return true;
+}
+
+/* find_session
+ - Session of `game`, created on first use; the least recently used ones beyond max_games are dropped
+   (a worker still searching one keeps it alive until it is done). */
+static std::shared_ptr<game_session> find_session(server_state &st, const std::string &game)
+{
+    {
+        std::lock_guard<std::mutex> lock(st.m);
+        for (auto it = st.games.begin(); it != st.games.end(); ++it)
+            if (it->first == game)
+            {
+                st.games.splice(st.games.begin(), st.games, it);
+                return it->second;
+            }
+    }
+
+    // allocate the table outside the lock; another worker may have created the game meanwhile
+    std::shared_ptr<game_session> created = std::make_shared<game_session>(st.opt->tt_mb);
+    std::lock_guard<std::mutex> lock(st.m);
+    for (auto it = st.games.begin(); it != st.games.end(); ++it)
+        if (it->first == game)
+            return it->second;
+    st.games.emplace_front(game, created);
+    while ((int)st.games.size() > std::max(1, st.opt->max_games))
+        st.games.pop_back();
+    return created;
+}
+
+static std::string status_line(server_state &st)
+{
+    std::lock_guard<std::mutex> lock(st.m);
+    unsigned long long warm_probes = st.warm_hits + st.warm_misses, cold_probes = st.cold_hits + st.cold_misses;
+    std::ostringstream out;
+    out << "status requests=" << st.requests
+        << " games=" << st.games.size()
+        << " active=" << st.active
+        << " queued=" << st.queue.size()
+        << " latency_ms_last=" << st.latency_last_ms
+        << " latency_ms_avg=" << (st.requests ? st.latency_sum_ms / st.requests : 0.0)
+        << " latency_ms_max=" << st.latency_max_ms
+        << " warm_requests=" << st.warm_requests
+        << " tt_hit_rate_warm=" << (warm_probes ? (double)st.warm_hits / warm_probes : 0.0)
+        << " tt_hit_rate_cold=" << (cold_probes ? (double)st.cold_hits / cold_probes : 0.0)
+        << " pondering=" << st.pondering.size()
+        << " ponder_searches=" << st.ponder_searches
+        << " ponder_hits=" << st.ponder_hits
+        << " ponder_answers=" << st.ponder_answers << '\n';
+    return out.str();
+}
+
+/* request_key
+ - Everything a request's answer depends on, as a string. Monsters and item cells are sorted, so the
+   key does not depend on the order the client encodes them in. */
+static std::string request_key(const position_request &req)
+{
+    const game_state &gs = req.gs;
+    std::vector<int> monsters, objects;
+    for (int k = 0; k < gs.n_monsters; ++k)
+        if (gs.monster_alive >> k & 1u)
+            monsters.push_back(gs.monster_pos[k].row << 8 | gs.monster_pos[k].col);
+    for (int k = 0; k < gs.n_items; ++k)
+        if (gs.item_alive >> k & 1u)
+            objects.push_back(gs.item_id[k] << 16 | gs.item_pos[k].row << 8 | gs.item_pos[k].col);
+    std::sort(monsters.begin(), monsters.end());
+    std::sort(objects.begin(), objects.end());
+
+    std::ostringstream out;
+    out << req.H << ' ' << req.W << ' ' << req.player << ' ' << req.depth << ' ' << req.movetime_ms;
+    for (const player &p : gs.players)
+        out << ' ' << p.H << ' ' << p.A << ' ' << p.D << ' ' << p.s << ' ' << p.S;
+    for (int p = 0; p < 2; ++p)
+        out << ' ' << (int)gs.pos[p].row << ':' << (int)gs.pos[p].col;
+    out << " i";
+    for (const item &it : req.items)
+        out << ' ' << it.dH << ':' << it.dA << ':' << it.dD << ':' << it.dS;
+    out << " m";
+    for (int m : monsters)
+        out << ' ' << m;
+    out << " o";
+    for (int o : objects)
+        out << ' ' << o;
+    return out.str();
+}
+
+static ponder_entry *find_pondered(game_session &g, const std::string &key)
+{
+    for (ponder_entry &e : g.pondered)
+        if (e.key == key)
+            return &e;
+    return nullptr;
+}
+
+/* next_request
+ - The request that follows req once `played` is answered (see play_move): the same side again while
+   its round goes on; otherwise the opponent plays its round move by move as this engine would play
+   it (the likeliest reply it can name), and then it is req.player's turn again.
+ - False if the game ends first, the prediction was cancelled, or the opponent's round runs too long. */
+static bool next_request(const position_request &req, const Move &played, const EngineOptions &eo,
+                         position_request &next)
+{
+    next = req;
+    for (int k = 0;; ++k)
+    {
+        if (!play_move(next, k == 0 ? played : best_move_from_request(next, eo).move) || eo.cancel->load())
+            return false;
+        if (next.gs.players[0].H <= 0 || next.gs.players[1].H <= 0)
+            return false;
+        if (next.player == req.player)
+            return true;
+        if (k == PONDER_OPPONENT_MOVES)
+            return false;
+    }
+}
+
+/* ponder
+ - Search ahead on g while no request is waiting: predict the next request after req was answered with
+   `played`, search it, and go on from that answer, up to PONDER_CACHE positions.
+ - Every search feeds the game's table; fixed-depth answers are also kept ready in g.pondered.
+ - The opponent's predicted moves are searched in the same table. Entries are keyed on the root
+   player (root_key in gcae.cpp), so those searches only share what holds for both roots, and a
+   pondered answer is what a fresh search of the request returns.
+ - Stops as soon as `cancel` is raised (a new request arrived); the caller holds g.m. */
+static void ponder(server_state &st, game_session &g, position_request req, Move played, std::atomic<bool> &cancel)
+{
+    EngineOptions eo = st.opt->engine;
+    eo.session = &g.search;
+    eo.tt = nullptr;
+    eo.cancel = &cancel;
+    for (int n = 0; n < PONDER_CACHE; ++n)
+    {
+        position_request next;
+        if (!next_request(req, played, eo, next))
+            return;
+        std::string key = request_key(next);
+        ponder_entry *e = find_pondered(g, key);
+        EngineResult r;
+        if (e)
+            r = e->result;
+        else
+        {
+            position_request deeper = next;
+            int budget = next.movetime_ms >= 0 ? next.movetime_ms : eo.movetime_ms;
+            if (budget > 0)
+                deeper.movetime_ms = budget * PONDER_TIME_FACTOR;
+            r = best_move_from_request(deeper, eo);
+            if (cancel.load())
+                return; // what was finished stays in the table
+            g.pondered.push_front({key, budget <= 0, r});
+            if ((int)g.pondered.size() > PONDER_CACHE)
+                g.pondered.pop_back();
+            std::lock_guard<std::mutex> lock(st.m);
+            ++st.ponder_searches;
+        }
+        req = next;
+        played = r.move;
+    }
+}
+
+/* server_worker
+ - Search queued positions until the server stops and the queue is empty.
+ - Requests without a game id share this worker's own session, like positions of one gcae run.
+ - With pondering on, an idle worker goes on searching the game it just answered (see ponder). */
+static void server_worker(server_state &st)
+{
+    game_session anonymous(st.opt->tt_mb);
+    std::atomic<bool> cancel(false);
+    while (true)
+    {
+        std::unique_ptr<server_job> job;
+        {
+            std::unique_lock<std::mutex> lock(st.m);
+            st.has_work.wait(lock, [&] { return !st.queue.empty() || st.stopping; });
+            if (st.queue.empty())
+                return;
+            job = std::move(st.queue.front());
+            st.queue.pop_front();
+            ++st.active;
+        }
+
+        std::shared_ptr<game_session> shared = job->game.empty() ? nullptr : find_session(st, job->game);
+        game_session &g = shared ? *shared : anonymous;
+        position_request req;
+        std::istringstream in(job->text);
+        bool parsed = read_request(in, req);
+        // pondering searches with the server's engine, so only its requests can use the pondered answers
+        bool ponder_on = st.opt->ponder && shared && parsed && job->algorithm == st.opt->engine.algorithm;
+        EngineResult result;
+        bool warm, pondered = false, answered = false;
+        {
+            std::lock_guard<std::mutex> lock(g.m);
+            warm = g.search.requests > 0;
+            const ponder_entry *e = ponder_on ? find_pondered(g, request_key(req)) : nullptr;
+            pondered = e != nullptr;
+            if (e && e->ready)
+            {
+                answered = true;
+                result = e->result;
+                result.stats = SearchStats(); // the work was done before the request came
+                result.stats.depth = e->result.stats.depth;
+            }
+            else
+            {
+                EngineOptions eo = st.opt->engine;
+                eo.session = &g.search;
+                eo.tt = nullptr;
+                eo.algorithm = job->algorithm;
+                // unparsable text gets the answer of a request without a board
+                result = best_move_from_request(parsed ? req : position_request(), eo);
+            }
+        }
+
+        std::ostringstream out;
+        out << result.move.type << ' '
+            << result.move.torow << ' '
+            << result.move.tocol << ' '
+            << result.score << ' '
+            << result.winChance << '\n';
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job->received).count();
+
+        {
+            std::lock_guard<std::mutex> lock(st.m);
+            --st.active;
+            ++st.requests;
+            st.latency_last_ms = ms;
+            st.latency_sum_ms += ms;
+            st.latency_max_ms = std::max(st.latency_max_ms, ms);
+            st.ponder_hits += pondered;
+            st.ponder_answers += answered;
+            if (warm)
+            {
+                ++st.warm_requests;
+                st.warm_hits += result.stats.tt_hits;
+                st.warm_misses += result.stats.tt_misses;
+            }
+            else
+            {
+                st.cold_hits += result.stats.tt_hits;
+                st.cold_misses += result.stats.tt_misses;
+            }
+        }
+        job->reply.set_value(out.str());
+
+        if (!ponder_on)
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(st.m);
+            if (!st.queue.empty() || st.stopping)
+                continue;
+            cancel.store(false);
+            st.pondering.push_back(&cancel);
+        }
+        {
+            std::lock_guard<std::mutex> lock(g.m);
+            ponder(st, g, req, result.move, cancel);
+        }
+        std::lock_guard<std::mutex> lock(st.m);
+        st.pondering.erase(std::find(st.pondering.begin(), st.pondering.end(), &cancel));
+    }
+}
+
+/* serve_connection
+ - Read requests from one client and answer them in order. */
+static void serve_connection(server_state &st, int fd)
+{
+    std::string buf, line, game, text;
+    char chunk[4096];
+    int algorithm = st.opt->engine.algorithm;
+    bool open = true;
+    while (open)
+    {
+        ssize_t n = recv(fd, chunk, sizeof chunk, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        buf.append(chunk, (size_t)n);
+
+        size_t start = 0, nl;
+        while (open && (nl = buf.find('\n', start)) != std::string::npos)
+        {
+            line.assign(buf, start, nl - start);
+            start = nl + 1;
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+
+            if (text.empty())
+            {
+                if (line.find_first_not_of(" \t") == std::string::npos || line == "END")
+                    continue;
+                if (line == "status")
+                {
+                    open = send_all(fd, status_line(st));
+                    continue;
+                }
+                if (line.compare(0, 5, "game ") == 0)
+                {
+                    game = line.substr(5);
+                    continue;
+                }
+                if (line == "engine minimax" || line == "engine mcts")
+                {
+                    algorithm = line == "engine mcts" ? ALGO_MCTS : ALGO_MINIMAX;
+                    continue;
+                }
+            }
+            if (line != "END")
+            {
+                text += line + "\n";
+                continue;
+            }
+
+            std::unique_ptr<server_job> job(new server_job);
+            job->game.swap(game);
+            job->algorithm = algorithm;
+            job->text.swap(text);
+            job->received = std::chrono::steady_clock::now();
+            std::future<std::string> reply = job->reply.get_future();
+            {
+                std::lock_guard<std::mutex> lock(st.m);
+                open = !st.stopping; // once stopping, the workers may be gone already
+                if (!open)
+                    break;
+                st.queue.push_back(std::move(job));
+                for (std::atomic<bool> *c : st.pondering)
+                    c->store(true);
+            }
+            st.has_work.notify_one();
+            open = send_all(fd, reply.get());
+            game.clear();
+            text.clear();
+            algorithm = st.opt->engine.algorithm;
+        }
+        buf.erase(0, start);
+    }
+
+    std::lock_guard<std::mutex> lock(st.m);
+    close(fd);
+    st.connections.erase(std::find(st.connections.begin(), st.connections.end(), fd));
+    st.connections_done.notify_all();
+}
+
+int run_server(const ServerOptions &opt)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (opt.path.empty() || opt.path.size() >= sizeof addr.sun_path)
+    {
+        std::cerr << "socket path must be 1.." << sizeof addr.sun_path - 1 << " characters\n";
+        return 1;
+    }
+    std::memcpy(addr.sun_path, opt.path.c_str(), opt.path.size() + 1);
+
+    // replace a socket left behind by an earlier server, but never any other kind of file
+    struct stat sb;
+    if (stat(opt.path.c_str(), &sb) == 0 && S_ISSOCK(sb.st_mode))
+        unlink(opt.path.c_str());
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0 || bind(lfd, (sockaddr *)&addr, sizeof addr) < 0 || listen(lfd, 64) < 0)
+    {
+        std::cerr << "cannot listen on " << opt.path << ": " << std::strerror(errno) << "\n";
+        if (lfd >= 0)
+            close(lfd);
+        return 1;
+    }
+
+    // every thread runs with SIGINT/SIGTERM blocked; one thread waits for them and stops the accept loop
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    server_state st;
+    st.opt = &opt;
+    std::thread signal_thread([&] {
+        int sig;
+        sigwait(&stop_signals, &sig);
+        shutdown(lfd, SHUT_RDWR);
+    });
+
+    std::vector<std::thread> workers;
+    for (int j = 0; j < std::max(1, opt.jobs); ++j)
+        workers.emplace_back(server_worker, std::ref(st));
+
+    std::cerr << "gcae listening on " << opt.path << "\n";
+    int status = 0;
+    while (true)
+    {
+        int fd = accept(lfd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EINVAL) // EINVAL: the signal thread shut the socket down
+            {
+                std::cerr << "accept failed: " << std::strerror(errno) << "\n";
+                status = 1;
+                pthread_kill(signal_thread.native_handle(), SIGTERM);
+            }
+            break;
+        }
+        std::lock_guard<std::mutex> lock(st.m);
+        st.connections.push_back(fd);
+        std::thread(serve_connection, std::ref(st), fd).detach();
+    }
+    signal_thread.join();
+    close(lfd);
+    unlink(opt.path.c_str());
+
+    // stop reading new requests, let the workers answer the queued ones, then wait for every client
+    {
+        std::unique_lock<std::mutex> lock(st.m);
+        st.stopping = true;
+        for (std::atomic<bool> *c : st.pondering)
+            c->store(true);
+        for (int fd : st.connections)
+            shutdown(fd, SHUT_RD);
+        st.has_work.notify_all();
+    }
+    for (std::thread &w : workers)
+        w.join();
+    std::unique_lock<std::mutex> lock(st.m);
+    st.connections_done.wait(lock, [&] { return st.connections.empty(); });
+    return status;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef GCAE_SERVER_HPP
+#define GCAE_SERVER_HPP
+
+#include "gcae.hpp"
+
+#include <cstddef>
+#include <string>
+
+// Settings of the long-lived engine process (gcae --serve PATH)
+struct ServerOptions
+{
+    std::string path;     // Unix domain socket to listen on
+    EngineOptions engine; // search settings of every request (the table comes from the game's session)
+    size_t tt_mb = 16;    // transposition table size of each game session
+    int jobs = 1;         // requests searched at the same time
+    int max_games = 16;   // game sessions kept; the least recently used one is dropped beyond this
+    bool ponder = false;  // between requests of a game, search the positions its next request is likely to ask
+};
+
+// Serve requests on opt.path until SIGINT/SIGTERM; returns the process exit code.
+//
+// A client sends any number of requests on one connection and gets one reply line per request:
+//   [game ID]                   optional: requests naming the same ID share a warm session
+//   <position, as on stdin>
+//   END                         -> "type row col score winChance"
+//   status                      -> "status requests=... queued=... latency_ms_avg=... ..."
+//
+// With ponder set, a worker that answered a request with a game id keeps searching that game until
+// the next request arrives (any request cancels it): the position the answer leads to, or after the
+// opponent's round as this engine would play it, goes into the game's table, and a later request for
+// it at a fixed depth is answered from the pondered result without searching.
+int run_server(const ServerOptions &opt);
+
+#endif // GCAE_SERVER_HPP